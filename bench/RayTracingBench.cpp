@@ -0,0 +1,388 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "src/CommandLine.h"
+#include "src/Renderer.h"
+#include "src/Scenes.h"
+
+//Micro benchmarks of the hot kernels on recorded rays, and full frame renders of every scene on 1 to N threads.
+//The results are printed as JSON, so runs on different machines and commits can be compared by a script.
+
+struct BenchmarkOptions{
+  int width = 160;
+  int height = 160;
+  int samplesPerPixel = 16;
+  std::size_t maxThreads = std::max(std::thread::hardware_concurrency(),1u);
+  int tileSize = 0; //0 picks the largest size up to 32 which gives every thread of maxThreads at least 4 tiles
+  int repetitions = 5; //Timed renders of every frame benchmark, after one untimed warm-up render
+  double minSeconds = 0.25; //Every micro benchmark repeats until it ran at least this long
+  std::string outputFile; //Empty prints the JSON to stdout
+};
+
+struct MicroResult{
+  std::string name;
+  std::size_t operations;
+  double seconds;
+};
+
+struct FrameResult{
+  std::size_t threads;
+  RenderStatistics statistics; //Of the fastest run
+  double medianSeconds;
+};
+
+struct SceneResult{
+  std::string name;
+  int tileSize;
+  std::size_t acceleratorBytes; //Nodes and leaf primitives, which scale with the precision of Real
+  std::vector<FrameResult> frames;
+};
+
+//Rays which were traced while rendering a scene, so the kernels see the directions and origins of real workloads
+struct RaySet{
+  std::vector<Ray> primary;
+  std::vector<Ray> secondary; //First bounce of every primary ray which hit a surface
+};
+
+RaySet recordRays(const Scene& scene, const Camera& camera, int width, int height){
+  RaySet rays;
+  RandomDevice device(7);
+  for (int j = 0; j < height; ++j) {
+	for (int i = 0; i < width; ++i) {
+	  auto u = (Real(i) + device.randomReal()) / Real(width - 1);
+	  auto v = (Real(j) + device.randomReal()) / Real(height - 1);
+	  Ray ray = camera.getRay(u, v, device);
+	  rays.primary.push_back(ray);
+	  std::optional<HitRecord> hit = scene.hit(ray, minimumHitDistance(ray), std::numeric_limits<Real>::infinity());
+	  Ray scattered;
+	  Vec3r attenuation;
+	  if(hit.has_value() && scene.material(hit->material).scatter(ray,hit.value(),scattered,attenuation,device)){
+		rays.secondary.push_back(scattered);
+	  }
+	}
+  }
+  return rays;
+}
+
+//Runs kernel, which performs operationsPerCall operations, until minSeconds have passed
+template<typename Kernel>
+MicroResult runMicro(std::string name, std::size_t operationsPerCall, double minSeconds, Kernel&& kernel){
+  kernel(); //Warm-up, so the first timed call does not pay for cold caches
+  std::size_t calls = 0;
+  auto startTime = std::chrono::high_resolution_clock::now();
+  double seconds = 0;
+  do{
+	kernel();
+	calls++;
+	seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-startTime).count();
+  } while(seconds < minSeconds);
+  return MicroResult{.name = std::move(name),.operations = calls * operationsPerCall,.seconds = seconds};
+}
+
+//Keeps the compiler from removing kernels whose results are otherwise unused
+volatile std::size_t benchmarkSink = 0;
+
+std::vector<MicroResult> runMicroBenchmarks(const BenchmarkOptions& options){
+  std::vector<MicroResult> results;
+  const double minSeconds = options.minSeconds;
+
+  RandomDevice64 sceneDevice(42);
+  auto [randomSceneData,randomCamera] = randomScene(sceneDevice,Real(1.0),BVHSettings());
+  RaySet rays = recordRays(randomSceneData,randomCamera,options.width,options.height);
+  std::vector<Ray> allRays = rays.primary;
+  allRays.insert(allRays.end(),rays.secondary.begin(),rays.secondary.end());
+
+  //The small spheres of randomScene, placed the same way, as primitives to test the rays against one by one
+  std::vector<SphereData> spheres;
+  std::vector<AABB> boxes;
+  {
+	RandomDevice64 device(42);
+	Material material(0);
+	for (int a = -11; a < 11; a += 2) {
+	  for (int b = -11; b < 11; b += 2) {
+		Vec3d center(a + 0.9 * device.randomReal(), 0.2, b + 0.9 * device.randomReal());
+		spheres.emplace_back(center,0.2,material);
+		boxes.push_back(spheres.back().boundingBox(Real(0.0)));
+	  }
+	}
+  }
+  results.push_back(runMicro("AABB::hit",allRays.size() * boxes.size(),minSeconds,[&](){
+	std::size_t hits = 0;
+	for(const Ray& ray : allRays){
+	  for(const AABB& box : boxes){
+		hits += box.hit(ray,minimumHitDistance(ray),std::numeric_limits<Real>::infinity());
+	  }
+	}
+	benchmarkSink = hits;
+  }));
+  results.push_back(runMicro("SphereData::hit",allRays.size() * spheres.size(),minSeconds,[&](){
+	std::size_t hits = 0;
+	for(const Ray& ray : allRays){
+	  for(const SphereData& sphere : spheres){
+		hits += sphere.hit(ray,minimumHitDistance(ray),std::numeric_limits<Real>::infinity()).has_value();
+	  }
+	}
+	benchmarkSink = hits;
+  }));
+
+  //The walls of the Cornell box against the camera rays of the Cornell box
+  {
+	RandomDevice64 device(42);
+	auto [cornell,cornellCamera] = cornellBox(device,Real(1.0),BVHSettings());
+	RaySet cornellRays = recordRays(cornell,cornellCamera,options.width,options.height);
+	Material material(0);
+	std::vector<AARectangleData> rectangles = {
+		AARectangleData(material,RectangleType::yz,0,555,0,555,555),
+		AARectangleData(material,RectangleType::yz,0,555,0,555,0),
+		AARectangleData(material,RectangleType::zx,213,343,227,332,554),
+		AARectangleData(material,RectangleType::zx,0,555,0,555,0),
+		AARectangleData(material,RectangleType::zx,0,555,0,555,555),
+		AARectangleData(material,RectangleType::xy,0,555,0,555,555)
+	};
+	results.push_back(runMicro("AARectangleData::hit",cornellRays.primary.size() * rectangles.size(),minSeconds,[&](){
+	  std::size_t hits = 0;
+	  for(const Ray& ray : cornellRays.primary){
+		for(const AARectangleData& rectangle : rectangles){
+		  hits += rectangle.hit(ray,minimumHitDistance(ray),std::numeric_limits<Real>::infinity()).has_value();
+		}
+	  }
+	  benchmarkSink = hits;
+	}));
+
+	//The same walls split into a mesh of triangles, tested one at a time and as one SIMD array
+	TriangleMesh mesh{.vertices = {},.faces = {},.material = material};
+	for(const AARectangleData& rectangle : rectangles){
+	  auto first = static_cast<std::uint32_t>(mesh.vertices.size());
+	  mesh.vertices.insert(mesh.vertices.end(),{rectangle.point(0,0),rectangle.point(1,0),rectangle.point(1,1),
+												rectangle.point(0,1)});
+	  mesh.faces.push_back({first,first + 1,first + 2});
+	  mesh.faces.push_back({first,first + 2,first + 3});
+	}
+	std::vector<TriangleData> triangles;
+	TriangleArray triangleArray;
+	for (std::uint32_t face = 0; face < mesh.faces.size(); ++face) {
+	  triangles.push_back(mesh.triangle(face));
+	  triangleArray.push_back(MeshTriangle(mesh,face));
+	}
+	results.push_back(runMicro("TriangleData::hit",cornellRays.primary.size() * triangles.size(),minSeconds,[&](){
+	  std::size_t hits = 0;
+	  for(const Ray& ray : cornellRays.primary){
+		for(const TriangleData& triangle : triangles){
+		  hits += triangle.hit(ray,minimumHitDistance(ray),std::numeric_limits<Real>::infinity()).has_value();
+		}
+	  }
+	  benchmarkSink = hits;
+	}));
+	results.push_back(runMicro("TriangleArray::closestHit",cornellRays.primary.size() * triangles.size(),minSeconds,[&](){
+	  std::size_t hits = 0;
+	  for(const Ray& ray : cornellRays.primary){
+		Real tMax = std::numeric_limits<Real>::infinity();
+		hits += triangleArray.closestHit(ray,0,triangles.size(),minimumHitDistance(ray),tMax) != triangles.size();
+	  }
+	  benchmarkSink = hits;
+	}));
+  }
+
+  //Closest hit through each acceleration structure layout, on the primary and the incoherent secondary rays
+  for(auto [layout,layoutName] : {std::pair{BVHLayout::Binary,"Binary"},std::pair{BVHLayout::Wide4,"BVH4"},
+								  std::pair{BVHLayout::Wide8,"BVH8"}}){
+	RandomDevice64 device(42);
+	BVHSettings bvhSettings;
+	bvhSettings.layout = layout;
+	Scene scene = randomScene(device,Real(1.0),bvhSettings).first;
+	for(auto [raySet,setName] : {std::pair{&rays.primary,"primary"},std::pair{&rays.secondary,"secondary"}}){
+	  results.push_back(runMicro(std::string("BVH::intersect/") + layoutName + "/" + setName,raySet->size(),minSeconds,[&](){
+		std::size_t hits = 0;
+		for(const Ray& ray : *raySet){
+		  hits += scene.intersect(ray,minimumHitDistance(ray),std::numeric_limits<Real>::infinity()).has_value();
+		}
+		benchmarkSink = hits;
+	  }));
+	}
+  }
+
+  constexpr std::size_t randomCalls = 1 << 20;
+  RandomDevice64 device(1);
+  results.push_back(runMicro("RandomDevice64::randomReal",randomCalls,minSeconds,[&](){
+	Real sum = 0;
+	for (std::size_t i = 0; i < randomCalls; ++i) {
+	  sum += device.randomReal();
+	}
+	benchmarkSink = std::size_t(sum);
+  }));
+  results.push_back(runMicro("RandomDevice64::randomInUnitSphere",randomCalls,minSeconds,[&](){
+	Real sum = 0;
+	for (std::size_t i = 0; i < randomCalls; ++i) {
+	  sum += device.randomInUnitSphere().x();
+	}
+	benchmarkSink = std::size_t(std::abs(sum));
+  }));
+  results.push_back(runMicro("RandomDevice64::randomInUnitDisk",randomCalls,minSeconds,[&](){
+	Real sum = 0;
+	for (std::size_t i = 0; i < randomCalls; ++i) {
+	  sum += device.randomInUnitDisk().x();
+	}
+	benchmarkSink = std::size_t(std::abs(sum));
+  }));
+  return results;
+}
+
+//Thread counts 1, 2, 4, ... up to and including maxThreads
+std::vector<std::size_t> threadCounts(std::size_t maxThreads){
+  std::vector<std::size_t> counts;
+  for (std::size_t threads = 1; threads < maxThreads; threads *= 2) {
+	counts.push_back(threads);
+  }
+  counts.push_back(maxThreads);
+  return counts;
+}
+
+//Threads only share the work of whole tiles, so a frame with fewer tiles than threads cannot show the scaling
+int frameTileSize(const BenchmarkOptions& options){
+  if(options.tileSize != 0){
+	return options.tileSize;
+  }
+  auto numTiles = [&options](int size){
+	return std::size_t((options.width + size - 1) / size) * std::size_t((options.height + size - 1) / size);
+  };
+  int tileSize = 32;
+  while(tileSize > 4 && numTiles(tileSize) < 4 * options.maxThreads){
+	tileSize /= 2;
+  }
+  return tileSize;
+}
+
+std::vector<SceneResult> runFrameBenchmarks(const BenchmarkOptions& options){
+  std::vector<SceneResult> results;
+  for(const NamedScene& namedScene : sceneList){
+	RenderSettings settings;
+	settings.imageWidth = options.width;
+	settings.imageHeight = options.height;
+	settings.samplesPerPixel = options.samplesPerPixel;
+	settings.tileSize = frameTileSize(options);
+
+	RandomDevice64 device(42);
+	auto [scene,camera] = namedScene.build(device,settings.aspectRatio(),BVHSettings());
+	SceneResult result{.name = std::string(namedScene.name),.tileSize = settings.tileSize,
+					   .acceleratorBytes = scene.acceleratorBytes(),.frames = {}};
+	for(std::size_t threads : threadCounts(options.maxThreads)){
+	  settings.numThreads = threads;
+	  Renderer renderer(settings);
+	  //The warm-up render allocates the thread pool and faults in the framebuffers and the scene
+	  (void) renderer.render(scene,camera);
+	  std::vector<RenderStatistics> runs;
+	  for (int run = 0; run < options.repetitions; ++run) {
+		runs.push_back(renderer.render(scene,camera));
+	  }
+	  std::sort(runs.begin(),runs.end(),[](const RenderStatistics& first, const RenderStatistics& second){
+		return first.seconds < second.seconds;
+	  });
+	  result.frames.push_back(FrameResult{.threads = threads,.statistics = runs.front(),
+										  .medianSeconds = runs[runs.size() / 2].seconds});
+	  std::cerr<<namedScene.name<<" on "<<threads<<" threads: "<<runs.front().seconds<<" seconds fastest, "
+	  <<result.frames.back().medianSeconds<<" median\n";
+	}
+	results.push_back(std::move(result));
+  }
+  return results;
+}
+
+void writeJson(std::ostream& out, const BenchmarkOptions& options, const std::vector<MicroResult>& micro,
+			   const std::vector<SceneResult>& scenes){
+  out<<"{\n";
+  out<<"  \"precision\": \""<<(sizeof(Real) == sizeof(float) ? "float" : "double")<<"\",\n";
+  out<<"  \"hardware_threads\": "<<std::thread::hardware_concurrency()<<",\n";
+  out<<"  \"micro\": [\n";
+  for (std::size_t k = 0; k < micro.size(); ++k) {
+	const MicroResult& result = micro[k];
+	auto operations = static_cast<double>(result.operations);
+	out<<"    {\"name\": \""<<result.name<<"\", \"operations\": "<<result.operations<<", \"seconds\": "<<result.seconds
+	<<", \"ns_per_op\": "<<result.seconds*1e9/operations<<", \"mops_per_s\": "<<operations/result.seconds/1e6<<"}"
+	<<(k + 1 < micro.size() ? "," : "")<<"\n";
+  }
+  out<<"  ],\n";
+  out<<"  \"frames\": [\n";
+  for (std::size_t k = 0; k < scenes.size(); ++k) {
+	const SceneResult& scene = scenes[k];
+	out<<"    {\"scene\": \""<<scene.name<<"\", \"width\": "<<options.width<<", \"height\": "<<options.height
+	<<", \"samples_per_pixel\": "<<options.samplesPerPixel<<", \"tile_size\": "<<scene.tileSize
+	<<", \"repetitions\": "<<options.repetitions<<", \"accelerator_bytes\": "<<scene.acceleratorBytes
+	<<", \"runs\": [\n";
+	double singleThreadSeconds = scene.frames.front().statistics.seconds;
+	for (std::size_t f = 0; f < scene.frames.size(); ++f) {
+	  const RenderStatistics& statistics = scene.frames[f].statistics;
+	  auto rays = static_cast<double>(statistics.rays);
+	  out<<"      {\"threads\": "<<scene.frames[f].threads<<", \"seconds\": "<<statistics.seconds
+	  <<", \"median_seconds\": "<<scene.frames[f].medianSeconds
+	  <<", \"rays\": "<<statistics.rays<<", \"mrays_per_s\": "<<rays/statistics.seconds/1e6
+	  <<", \"ns_per_ray\": "<<statistics.seconds*1e9/rays
+	  <<", \"speedup\": "<<singleThreadSeconds/statistics.seconds<<"}"<<(f + 1 < scene.frames.size() ? "," : "")<<"\n";
+	}
+	out<<"    ]}"<<(k + 1 < scenes.size() ? "," : "")<<"\n";
+  }
+  out<<"  ]\n";
+  out<<"}\n";
+}
+
+constexpr const char* usage =
+	"Usage: RayTracingBench [options] > results.json\n"
+	"  --width N, --height N   frame size and size of the recorded ray sets, 160x160 by default\n"
+	"  --spp N                 samples per pixel of the frame benchmarks, 16 by default\n"
+	"  --max-threads N         largest thread count of the scaling runs, all hardware threads by default\n"
+	"  --tile-size N           tile size of the frame benchmarks, by default the largest up to 32 which gives\n"
+	"                          every thread at least 4 tiles\n"
+	"  --repetitions N         timed renders of every frame benchmark after a warm-up render, the fastest and\n"
+	"                          the median are reported, 5 by default\n"
+	"  --min-seconds X         minimum run time of every micro benchmark, 0.25 by default\n"
+	"  --output FILE           write the JSON to FILE instead of stdout\n";
+
+int main(int argc, char** argv){
+  BenchmarkOptions options;
+  for (int k = 1; k < argc; ++k) {
+	std::string_view arg = argv[k];
+	std::string_view value = k + 1 < argc ? std::string_view(argv[k+1]) : std::string_view();
+	bool valid = true;
+	if(arg == "--width"){
+	  valid = parseNumber(value,options.width) && options.width > 1;
+	}else if(arg == "--height"){
+	  valid = parseNumber(value,options.height) && options.height > 1;
+	}else if(arg == "--spp"){
+	  valid = parseNumber(value,options.samplesPerPixel) && options.samplesPerPixel > 0;
+	}else if(arg == "--max-threads"){
+	  valid = parseNumber(value,options.maxThreads) && options.maxThreads > 0;
+	}else if(arg == "--tile-size"){
+	  valid = parseNumber(value,options.tileSize) && options.tileSize > 0;
+	}else if(arg == "--repetitions"){
+	  valid = parseNumber(value,options.repetitions) && options.repetitions > 0;
+	}else if(arg == "--min-seconds"){
+	  valid = parseNumber(value,options.minSeconds) && options.minSeconds > 0;
+	}else if(arg == "--output"){
+	  options.outputFile = value;
+	  valid = !options.outputFile.empty();
+	}else{
+	  std::cerr<<usage;
+	  return arg == "--help" ? 0 : 1;
+	}
+	if(!valid){
+	  std::cerr<<"Invalid or missing value for "<<arg<<"\n"<<usage;
+	  return 1;
+	}
+	++k;
+  }
+
+  std::vector<MicroResult> micro = runMicroBenchmarks(options);
+  std::vector<SceneResult> scenes = runFrameBenchmarks(options);
+  if(options.outputFile.empty()){
+	writeJson(std::cout,options,micro,scenes);
+  }else{
+	std::ofstream file(options.outputFile);
+	writeJson(file,options,micro,scenes);
+  }
+  return 0;
+}
@@ -1,430 +1,363 @@
 #include <iostream>
-#include <chrono>
-#include <numeric>
 #include <algorithm>
-#include <execution>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <limits>
 #include <mutex>
-#include <thread>
-#include <atomic>
-#include <condition_variable>
-
-#include "src/Random.h"
-#include "src/Vec3.h"
-#include "src/Ray.h"
-#include "src/Sphere.h"
-#include "src/Scene.h"
-#include "src/Camera.h"
-#include "src/BoundingVolumeHierarchy.h"
-
-std::pair<Scene,Camera>  exampleScene(RandomDevice& device, Real aspectRatio) {
-  Scene scene;
-
-  Material groundMat = scene.addMaterial(DiffuseMaterial(Vec3r(0.8,0.8,0.0)));
-  Material ballMat  = scene.addMaterial(DiffuseMaterial(Vec3r(0.1,0.2,0.5)));
-  Material glassMat = scene.addMaterial(DielectricMaterial(1.3));
-  Material metalMat = scene.addMaterial(MetalMaterial(Vec3r(0.8,0.6,0.2),0.0));
-
-  scene.addSphere(SphereData(Vec3r(0.0, -100.5, -1.0), 100,groundMat));
-  scene.addSphere(SphereData(Vec3r(0.0, 0.0, -1.0), 0.5,ballMat));
-  scene.addSphere(SphereData(Vec3r(-1.0, 0.0, -1.0), 0.5, glassMat));
-  scene.addSphere(SphereData(Vec3r(-1.0, 0.0, -1.0), -0.45, glassMat));
-
-  scene.addSphere(SphereData(Vec3r(1.0, 0.0, -1.0), 0.5, metalMat,Vec3r(50.0,0.0,0.0)));
-  scene.setBackgroundColor(Vec3r(0.7,0.8,1.0));
-
-  Vec3r lookfrom(13, 2, 3);
-  Vec3r lookat(0, 0, 0);
-  Real distToFocus = 10.0;
-  Real aperture = 0.1;
-  Real shutterTime = Real(1 / 250.0);
-
-  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), 20, aspectRatio, aperture, distToFocus,shutterTime);
-  scene.initialize(shutterTime,device);
-  scene.setBackgroundColor(Vec3r(0.7,0.8,1.0));
-
-  return std::make_pair(scene,camera);
-}
-
-std::pair<Scene,Camera> randomScene(RandomDevice& device, Real aspectRatio) {
-  Scene scene;
-
-  Material material = scene.addMaterial(DiffuseMaterial(Vec3r(0.5,0.5,0.5)));
-  scene.addSphere(SphereData(Vec3d(0, -1000, 0), 1000, material));
-
-  for (int a = -11; a < 11; a++) {
-	for (int b = -11; b < 11; b++) {
-	  auto chooseMat = device.randomReal();
-	  Vec3d center(a + 0.9 * device.randomReal(), 0.2, b + 0.9 * device.randomReal());
-	  Vec3r velocity(0.0,0.0,0.0);
-	  if ((center - Vec3d(4, 0.2, 0)).norm() > 0.9) {
-		Material sphereMaterial;
-
-		if (chooseMat < 0.7) {
-		  // diffuse
-		  Vec3d color1 = device.randomVec();
-		  Vec3d color2 = device.randomVec();
-		  sphereMaterial = scene.addMaterial(DiffuseMaterial(color1*color2));
-		  velocity.y() = device.randomReal(0.0,25.0);
-		} else if (chooseMat < 0.9) {
-		  // metal
-		  sphereMaterial = scene.addMaterial(
-			  MetalMaterial(0.5*device.randomVec()+0.5,device.randomReal(0.0,0.5))
-			  );
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "src/CommandLine.h"
+#include "src/Renderer.h"
+#include "src/Scenes.h"
+#include "src/SceneFile.h"
+#include "src/ImageOutput.h"
+
+//Settings of the command line tool on top of those of the renderer
+struct Options{
+  RenderSettings render;
+  std::string sceneName = "cornellBox";
+  std::string sceneFile; //Binary scene file to render instead of a built in scene
+  BVHSettings bvh;
+  ImageFormat imageFormat = ImageFormat::PPM;
+  std::string imageFile; //Empty writes the image to stdout
+  std::string sampleCountFile = "sampleCounts.pgm"; //Written when adaptive sampling is on
+  std::string heatmapFile = "traversalCost.ppm"; //Written when instrumentation is compiled in
+  int frames = 1;
+  Real frameTime = Real(1.0 / 24.0); //Seconds between frames, over which the spheres move along their velocity
+  Real rebuildThreshold = Real(1.5);
+  bool measureTraversal = false;
+  bool measurePathLength = false;
+};
 
-		} else {
-		  sphereMaterial = scene.addMaterial(DielectricMaterial(device.randomReal(1.1, 1.7)));
-		}
-		scene.addSphere(SphereData(center, 0.2, sphereMaterial, velocity));
-	  }
+constexpr const char* usage =
+	"Usage: RayTracing [options] > image.ppm\n"
+	"  --scene NAME            example, random, randomDark, simpleLight, cornellBox (default) or instancedField\n"
+	"  --scene-file FILE       render a binary scene file written by RayTracingSceneConverter\n"
+	"  --width N, --height N   image size in pixels, 600x600 by default\n"
+	"  --spp N                 samples per pixel, 50 by default\n"
+	"  --depth N               maximum number of bounces, 50 by default\n"
+	"  --threads N             worker threads, all hardware threads by default\n"
+	"  --tile-size N           width and height of the tiles, 32 by default\n"
+	"  --packet-size N         primary rays per packet: 1, 4, 8 or 16, 8 by default and 1 in instrumented builds,\n"
+	"                          not with --wavefront or --adaptive\n"
+	"  --wavefront             trace with the wavefront integrator, which has no next event estimation or Russian\n"
+	"                          roulette and cannot be combined with their options or --adaptive\n"
+	"  --no-nee                disable next event estimation\n"
+	"  --no-roulette           disable Russian roulette\n"
+	"  --roulette-depth N      bounces before Russian roulette starts, 3 by default\n"
+	"  --adaptive              adaptive sampling, the average samples per pixel stays --spp\n"
+	"  --adaptive-threshold X  target standard error of the displayed value, 0.005 by default\n"
+	"  --sample-counts FILE    sample count map written with --adaptive, sampleCounts.pgm by default\n"
+	"  --heatmap FILE          traversal cost per pixel of instrumented builds, traversalCost.ppm by default\n"
+	"  --bvh-build METHOD      median, sah or parallel-sah (default)\n"
+	"  --bvh-layout LAYOUT     binary, bvh4 (default) or bvh8\n"
+	"  --bvh-cache DIR         store built hierarchies in DIR and reuse them while the geometry is unchanged\n"
+	"  --format FORMAT         ppm (default), pfm or png\n"
+	"  --output FILE           write the image to FILE instead of stdout\n"
+	"  --frames N              render an animation of N frames, written to FILE0000.ext, FILE0001.ext, ...\n"
+	"  --frame-time X          seconds between frames, 1/24 by default\n"
+	"  --rebuild-threshold X   rebuild the BVH of a frame instead of refitting it once that increases its SAH\n"
+	"                          cost more than X times over its last build, 1.5 by default\n"
+	"  --measure-traversal     report acceleration structure statistics of the primary rays\n"
+	"  --measure-paths         report path lengths with and without Russian roulette\n";
+
+std::optional<Options> parseOptions(int argc, char** argv){
+  Options options;
+  RenderSettings& render = options.render;
+  bool packetSizeGiven = false;
+  bool pathOptionGiven = false; //Next event estimation or Russian roulette
+  for (int k = 1; k < argc; ++k) {
+	std::string_view arg = argv[k];
+	//Value of an option which takes one, or an empty view if it is missing
+	auto value = [&]() -> std::string_view { return k + 1 < argc ? std::string_view(argv[++k]) : std::string_view();};
+	bool valid = true;
+	if(arg == "--help"){
+	  std::cerr<<usage;
+	  return std::nullopt;
+	}else if(arg == "--scene"){
+	  options.sceneName = value();
+	  valid = findScene(options.sceneName).has_value();
+	}else if(arg == "--scene-file"){
+	  options.sceneFile = value();
+	  valid = !options.sceneFile.empty();
+	}else if(arg == "--width"){
+	  valid = parseNumber(value(),render.imageWidth) && render.imageWidth > 1;
+	}else if(arg == "--height"){
+	  valid = parseNumber(value(),render.imageHeight) && render.imageHeight > 1;
+	}else if(arg == "--spp"){
+	  valid = parseNumber(value(),render.samplesPerPixel) && render.samplesPerPixel > 0;
+	}else if(arg == "--depth"){
+	  valid = parseNumber(value(),render.maxDepth) && render.maxDepth > 0;
+	}else if(arg == "--threads"){
+	  valid = parseNumber(value(),render.numThreads) && render.numThreads > 0;
+	}else if(arg == "--tile-size"){
+	  valid = parseNumber(value(),render.tileSize) && render.tileSize > 0;
+	}else if(arg == "--packet-size"){
+	  packetSizeGiven = true;
+	  valid = parseNumber(value(),render.primaryPacketSize) &&
+		  (render.primaryPacketSize == 1 || render.primaryPacketSize == 4 ||
+		   render.primaryPacketSize == 8 || render.primaryPacketSize == 16);
+	}else if(arg == "--wavefront"){
+	  render.useWavefrontIntegrator = true;
+	}else if(arg == "--no-nee"){
+	  pathOptionGiven = true;
+	  render.useNextEventEstimation = false;
+	}else if(arg == "--no-roulette"){
+	  pathOptionGiven = true;
+	  render.useRussianRoulette = false;
+	}else if(arg == "--roulette-depth"){
+	  pathOptionGiven = true;
+	  valid = parseNumber(value(),render.russianRouletteDepth) && render.russianRouletteDepth > 0;
+	}else if(arg == "--adaptive"){
+	  render.useAdaptiveSampling = true;
+	}else if(arg == "--adaptive-threshold"){
+	  valid = parseNumber(value(),render.adaptiveErrorThreshold) && render.adaptiveErrorThreshold > 0;
+	}else if(arg == "--sample-counts"){
+	  options.sampleCountFile = value();
+	  valid = !options.sampleCountFile.empty();
+	}else if(arg == "--heatmap"){
+	  options.heatmapFile = value();
+	  valid = !options.heatmapFile.empty();
+	}else if(arg == "--bvh-build"){
+	  std::string_view method = value();
+	  valid = method == "median" || method == "sah" || method == "parallel-sah";
+	  options.bvh.buildMethod = method == "median" ? BVHBuildMethod::RandomAxisMedian :
+								method == "sah" ? BVHBuildMethod::BinnedSAH : BVHBuildMethod::ParallelBinnedSAH;
+	}else if(arg == "--bvh-layout"){
+	  std::string_view layout = value();
+	  valid = layout == "binary" || layout == "bvh4" || layout == "bvh8";
+	  options.bvh.layout = layout == "binary" ? BVHLayout::Binary : layout == "bvh8" ? BVHLayout::Wide8 : BVHLayout::Wide4;
+	}else if(arg == "--bvh-cache"){
+	  options.bvh.cacheDirectory = value();
+	  valid = !options.bvh.cacheDirectory.empty();
+	}else if(arg == "--format"){
+	  std::string_view format = value();
+	  valid = format == "ppm" || format == "pfm" || format == "png";
+	  options.imageFormat = format == "pfm" ? ImageFormat::PFM : format == "png" ? ImageFormat::PNG : ImageFormat::PPM;
+	}else if(arg == "--output"){
+	  options.imageFile = value();
+	  valid = !options.imageFile.empty();
+	}else if(arg == "--frames"){
+	  valid = parseNumber(value(),options.frames) && options.frames > 0;
+	}else if(arg == "--frame-time"){
+	  valid = parseNumber(value(),options.frameTime) && options.frameTime >= 0;
+	}else if(arg == "--rebuild-threshold"){
+	  valid = parseNumber(value(),options.rebuildThreshold) && options.rebuildThreshold >= 1;
+	}else if(arg == "--measure-traversal"){
+	  options.measureTraversal = true;
+	}else if(arg == "--measure-paths"){
+	  options.measurePathLength = true;
+	}else{
+	  std::cerr<<"Unknown option "<<arg<<"\n"<<usage;
+	  return std::nullopt;
 	}
-  }
-
-  material = scene.addMaterial(DielectricMaterial(1.5));
-  scene.addSphere(SphereData(Vec3d(0, 1, 0), 1, material));
-
-  material = scene.addMaterial(DiffuseMaterial(Vec3r(0.4, 0.2, 0.1)));
-  scene.addSphere(SphereData(Vec3d(-4, 1, 0), 1, material));
-
-  material = scene.addMaterial(MetalMaterial(Vec3r(0.7,0.6,0.5),0.0));
-  scene.addSphere(SphereData(Vec3d(4, 1, 0), 1, material));
-
-
-  Vec3r lookfrom(13, 2, 3);
-  Vec3r lookat(0, 0, 0);
-  Real distToFocus = 10.0;
-  Real aperture = 0.1;
-  Real shutterTime = Real(1 / 250.0);
-
-  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), 20, aspectRatio, aperture, distToFocus,shutterTime);
-  scene.initialize(shutterTime,device);
-  scene.setBackgroundColor(Vec3r(0.7,0.8,1.0));
-
-  return std::make_pair(scene,camera);
-}
-
-std::pair<Scene,Camera> randomSceneDark(RandomDevice& device, Real aspectRatio) {
-  Scene scene;
-
-  Material material = scene.addMaterial(DiffuseMaterial(Vec3r(0.5,0.5,0.5)));
-  scene.addSphere(SphereData(Vec3d(0, -1000, 0), 1000, material));
-
-  for (int a = -11; a < 11; a++) {
-	for (int b = -11; b < 11; b++) {
-	  auto chooseMat = device.randomReal();
-	  Vec3d center(a + 0.9 * device.randomReal(), 0.2, b + 0.9 * device.randomReal());
-	  Vec3r velocity(0.0,0.0,0.0);
-	  if ((center - Vec3d(4, 0.2, 0)).norm() > 0.9) {
-		Material sphereMaterial;
-
-		if (chooseMat < 0.7) {
-		  // diffuse
-		  Vec3d color1 = device.randomVec();
-		  Vec3d color2 = device.randomVec();
-		  sphereMaterial = scene.addMaterial(DiffuseMaterial(color1*color2));
-		  velocity.y() = device.randomReal(0.0,25.0);
-		} else if (chooseMat < 0.9) {
-		  // metal
-		  sphereMaterial = scene.addMaterial(
-			  MetalMaterial(0.5*device.randomVec()+0.5,device.randomReal(0.0,0.5))
-		  );
-
-		} else {
-		  sphereMaterial = scene.addMaterial(DielectricMaterial(device.randomReal(1.1, 1.7)));
-		}
-		scene.addSphere(SphereData(center, 0.2, sphereMaterial, velocity));
-	  }
+	if(!valid){
+	  std::cerr<<"Invalid or missing value for "<<arg<<"\n"<<usage;
+	  return std::nullopt;
 	}
   }
-
-  material = scene.addMaterial(DielectricMaterial(1.5));
-  scene.addSphere(SphereData(Vec3d(0, 1, 0), 1, material));
-
-  material = scene.addMaterial(DiffuseMaterial(Vec3r(0.4, 0.2, 0.1),Vec3r(10.0,10.0,10.0)));
-  scene.addSphere(SphereData(Vec3d(-4, 1, 0), 1, material));
-
-  material = scene.addMaterial(MetalMaterial(Vec3r(0.7,0.6,0.5),0.0));
-  scene.addSphere(SphereData(Vec3d(4, 1, 0), 1, material));
-
-
-  Vec3r lookfrom(13, 2, 3);
-  Vec3r lookat(0, 0, 0);
-  Real distToFocus = 10.0;
-  Real aperture = 0.1;
-  Real shutterTime = Real(1 / 250.0);
-
-  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), 20, aspectRatio, aperture, distToFocus,shutterTime);
-  scene.initialize(shutterTime,device);
-  scene.setBackgroundColor(Vec3r(0.0,0.0,0.0));
-
-  return std::make_pair(scene,camera);
-}
-
-std::pair<Scene,Camera> simpleLight(RandomDevice& device, Real aspectRatio){
-  Scene scene;
-
-  Vec3r lookfrom(26,3,6);
-  Vec3r lookat(0, 2, 0);
-  Real aperture = 0.1;
-  Real shutterTime = Real(1 / 250.0);
-
-  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), 20, aspectRatio, aperture, (lookfrom-lookat).norm(),shutterTime);
-
-  Material sphereMat = scene.addMaterial(DiffuseMaterial(Vec3r(0.5,0.8,0.2)));
-
-  scene.addSphere(SphereData(Vec3r(0.0,-1000.0,0.0),1000,sphereMat));
-  scene.addSphere(SphereData(Vec3r(0.0,2.0,0.0),2,sphereMat));
-
-  Material light = scene.addMaterial(DiffuseMaterial(Vec3r(0.0,0.0,0.0),Vec3r(4.0,4.0,4.0)));
-
-  scene.addRectangle(AARectangleData(light,RectangleType::xy,3,5,1,3,-2));
-
-  scene.initialize(shutterTime,device);
-  scene.setBackgroundColor(Vec3r(0.0,0.0,0.0));
-  return std::make_pair(scene,camera);
-}
-
-std::pair<Scene,Camera> cornellBox(RandomDevice& device, Real aspectRatio){
-  Scene scene;
-
-  Vec3r lookfrom(278,278,-800);
-  Vec3r lookat(278,278, 0);
-  Real aperture = 0.1;
-  Real shutterTime = Real(1 / 250.0);
-  Real fov = 40.0;
-
-  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), fov, aspectRatio, aperture, (lookfrom-lookat).norm(),shutterTime);
-
-
-  Material red = scene.addMaterial(DiffuseMaterial(Vec3r(.65,.05,.05)));
-  Material white = scene.addMaterial(DiffuseMaterial(Vec3r(.73,.73,.73)));
-  Material green = scene.addMaterial(DiffuseMaterial(Vec3r(.12,.45,.15)));
-
-  Material light= scene.addMaterial(DiffuseMaterial(Vec3r(.0,.0,.0),Vec3r(15,15,15)));
-
-  scene.addRectangle(AARectangleData(green,RectangleType::yz,0,555,0,555,555));
-  scene.addRectangle(AARectangleData(red,RectangleType::yz,0,555,0,555,0));
-  scene.addRectangle(AARectangleData(light,RectangleType::zx,213,343,227,332,554));
-  scene.addRectangle(AARectangleData(white,RectangleType::zx,0,555,0,555,0));
-  scene.addRectangle(AARectangleData(white,RectangleType::zx,0,555,0,555,555));
-  scene.addRectangle(AARectangleData(white,RectangleType::xy,0,555,0,555,555));
-
-  scene.initialize(shutterTime,device);
-  scene.setBackgroundColor(Vec3r(0.0,0.0,0.0));
-  return std::make_pair(scene,camera);
-}
-
-Vec3r rayColor(const Ray &ray, const Scene &scene, int depth, RandomDevice& device) {
-  if (depth <= 0) {
-	return Vec3r(0, 0, 0);
+  //Only the scalar path tracer counts its traversal work, which the statistics and the heat map are made of
+  if(instrumentationEnabled && (render.useWavefrontIntegrator || render.primaryPacketSize != 1)){
+	std::cerr<<"Instrumented builds trace rays one at a time, --wavefront and --packet-size other than 1 are not "
+			   "available\n"<<usage;
+	return std::nullopt;
   }
-  std::optional<HitRecord> hit = scene.hit(ray, 0.001, std::numeric_limits<Real>::infinity());
-  if (hit.has_value()) {
-	Ray scattered;
-	Vec3r attenuation;
-	Vec3r emitted = scene.material(hit->material).emitted(hit.value()) ;
-	bool scatter = scene.material(hit->material).scatter(ray,hit.value(),scattered,attenuation,device);
-	if(!scatter){
-	  return emitted;
-	}
-	return emitted + attenuation * rayColor(scattered,scene,depth-1,device);
+  //Settings which the chosen integrator would ignore, see RenderSettings
+  if(render.useWavefrontIntegrator && render.useAdaptiveSampling){
+	std::cerr<<"--wavefront and --adaptive cannot be combined\n"<<usage;
+	return std::nullopt;
   }
-
-  return scene.backgroundColor();
+  if(packetSizeGiven && (render.useWavefrontIntegrator || render.useAdaptiveSampling)){
+	std::cerr<<"--packet-size does not apply to --wavefront or --adaptive, which trace their own rays\n"<<usage;
+	return std::nullopt;
+  }
+  if(pathOptionGiven && render.useWavefrontIntegrator){
+	std::cerr<<"--wavefront has no next event estimation or Russian roulette, so --no-nee, --no-roulette and "
+			   "--roulette-depth do not apply\n"<<usage;
+	return std::nullopt;
+  }
+  if(options.frames > 1 && options.imageFile.empty()){
+	std::cerr<<"An animation needs --output to name its frames\n"<<usage;
+	return std::nullopt;
+  }
+  options.bvh.refittable = options.frames > 1;
+  return options;
 }
 
-std::ostream &writeColor(std::ostream &ostream, const Vec3r &color, int samplesPerPixel) {
-  Vec3r actualColor = color;
-  Real scale = (1.0 / samplesPerPixel);
-  actualColor.x() = sqrt(scale * actualColor.x());
-  actualColor.y() = sqrt(scale * actualColor.y());
-  actualColor.z() = sqrt(scale * actualColor.z());
-
-  ostream << static_cast<int>(255.999 * actualColor.x()) << ' ' <<
-		  static_cast<int>(255.999 * actualColor.y()) << ' ' <<
-		  static_cast<int>(255.999 * actualColor.z()) << '\n';
-  return ostream;
+//Name of a frame of an animation: image.png becomes image0007.png for frame 7
+std::string frameFileName(const std::string& imageFile, int frame){
+  std::filesystem::path path(imageFile);
+  std::string number = std::to_string(frame);
+  number.insert(0,number.size() < 4 ? 4 - number.size() : 0,'0');
+  return (path.parent_path() / (path.stem().string() + number + path.extension().string())).string();
 }
 
-struct BlockJob{
-  int rowStart;
-  int colStart;
-  int numRows;
-  int numCols;
-
-  int samplesPerPixel;
-  int maxDepth;
-  RandomDevice device;
-  std::vector<Vec3r> colors;
-};
-void runBlockJob(BlockJob& job,const Camera& camera, const Scene& scene, int imageWidth, int imageHeight){
-  for (int j = job.rowStart; j < job.rowStart + job.numRows; ++j) {
-	//std::cerr<<"starting line: "<<j<<'\r';
-	for (int i = job.colStart; i < job.colStart + job.numCols; ++i) {
-	  Vec3r pixelColor(0, 0, 0);
-	  for (int k = 0; k < job.samplesPerPixel; ++k) {
-		auto u = (i + job.device.randomReal()) / (imageWidth - 1);
-		auto v = (j + job.device.randomReal()) / (imageHeight - 1);
-		Ray ray = camera.getRay(u, v,job.device);
-		pixelColor += rayColor(ray, scene, job.maxDepth,job.device);
-	  }
-	  int jobJ = j-job.rowStart;
-	  int jobI = i-job.colStart;
-	  job.colors[size_t(jobJ*job.numCols+jobI)] = pixelColor;
+//Writes the number of samples of every pixel as a grey scale image, brightest where the most samples were taken.
+//Returns whether the file could be written.
+bool writeSampleCounts(const char* fileName, const Framebuffer<int>& sampleCounts){
+  int minCount = std::numeric_limits<int>::max();
+  int maxCount = 1;
+  long total = 0;
+  for (int j = 0; j < sampleCounts.height(); ++j) {
+	for (int i = 0; i < sampleCounts.width(); ++i) {
+	  minCount = std::min(minCount,sampleCounts(i,j));
+	  maxCount = std::max(maxCount,sampleCounts(i,j));
+	  total += sampleCounts(i,j);
 	}
   }
-}
-void runWorkerThread(const Camera& camera, const Scene& scene, int imageWidth, int imageHeight,
-				 std::mutex& mutex, std::condition_variable& cv,
-				 std::atomic<int>& completedThreads,
-				 std::atomic<size_t>& nextJobIndex,
-				 std::vector<BlockJob>& jobs,
-				 std::vector<BlockJob>& imageBlocks){
-  BlockJob job{
-	.device = RandomDevice(1)
-  };
-  {
-	std::lock_guard<std::mutex> lock(mutex);
-	if(nextJobIndex == jobs.size()){
-	  completedThreads++;
-	  cv.notify_one();
-	  return;
+  std::cerr<<"Samples per pixel: "<<minCount<<" minimum, "
+  <<static_cast<double>(total)/(sampleCounts.width()*sampleCounts.height())<<" average, "<<maxCount<<" maximum\n";
+  std::ofstream file(fileName);
+  file << "P2\n" << sampleCounts.width() << ' ' << sampleCounts.height() << "\n255\n";
+  for (int j = sampleCounts.height()-1 ; j >= 0 ; --j) {
+	for (int i = 0; i < sampleCounts.width(); ++i) {
+	  file << 255 * sampleCounts(i,j) / maxCount << ' ';
 	}
-	job = jobs[nextJobIndex];
-	nextJobIndex++;
-	std::cerr<<"starting with job: "<< nextJobIndex<<"/"<<jobs.size()<<"\r"<<std::flush;
+	file << '\n';
   }
-  while(true){
-	runBlockJob(job,camera,scene,imageWidth,imageHeight);
-	{
-	  std::lock_guard<std::mutex> lock(mutex);
-	  imageBlocks.push_back(job);
-	  if(nextJobIndex == jobs.size()){
-		completedThreads++;
-		cv.notify_one();
-		return;
-	  }else{
-		job = jobs[nextJobIndex];
-		nextJobIndex++;
-		std::cerr<<"starting with job: "<< nextJobIndex<<"/"<<jobs.size()<<"\r"<<std::flush;
-	  }
-	}
+  return file.good();
+}
+
+//Work counted by an instrumented build, merged over all render threads
+void reportRenderWork(const PathStatistics& work){
+  auto rays = static_cast<double>(work.traversal.rays);
+  auto paths = static_cast<double>(work.paths);
+  std::cerr<<"Per ray: "<<static_cast<double>(work.traversal.boxTests)/rays<<" box tests, "
+  <<static_cast<double>(work.traversal.nodesVisited)/rays<<" nodes visited, "
+  <<static_cast<double>(work.traversal.leavesVisited)/rays<<" leaves visited, "
+  <<static_cast<double>(work.traversal.primitiveTests)/rays<<" primitive tests, "
+  <<100.0*static_cast<double>(work.traversal.hits)/rays<<"% hit\n";
+  std::cerr<<"Per path: "<<static_cast<double>(work.segments)/paths<<" segments, "
+  <<static_cast<double>(work.shadowRays)/paths<<" shadow rays\n";
+  std::cerr<<"Path lengths:";
+  for (std::size_t length = 1; length < work.pathLengths.size(); ++length) {
+	std::cerr<<' '<<length<<(length == PathStatistics::maxPathLength ? "+" : "")<<": "
+	<<100.0*static_cast<double>(work.pathLengths[length])/paths<<'%';
   }
+  std::cerr<<"\n";
 }
 
-int main() {
+//How much of the acceleration structure the primary rays touched
+void reportTraversal(const TraversalCounters& counters){
+  auto rays = static_cast<double>(counters.rays);
+  std::cerr<<"Per primary ray: "<<static_cast<double>(counters.boxTests)/rays<<" box tests, "
+  <<static_cast<double>(counters.nodesVisited)/rays<<" nodes visited, "
+  <<static_cast<double>(counters.leavesVisited)/rays<<" leaves visited, "
+  <<static_cast<double>(counters.primitiveTests)/rays<<" primitive tests\n";
+}
 
-  //Image
-//  constexpr auto aspectRatio = 16.0 / 9.0;
-//  constexpr int imageWidth = 1920;
-//  constexpr int imageHeight = static_cast<int>(imageWidth / aspectRatio);
-  constexpr int samplesPerPixel = 50;
-  constexpr int maxDepth = 50;
+//Rays per path and mean radiance without and with Russian roulette
+void reportPaths(const std::array<PathMeasurement,2>& measurements){
+  for(const PathMeasurement& measurement : measurements){
+	auto paths = static_cast<double>(measurement.statistics.paths);
+	std::cerr<<"Russian roulette "<<(measurement.roulette ? "on" : "off")<<": "
+	<<static_cast<double>(measurement.statistics.segments)/paths<<" segments and "
+	<<static_cast<double>(measurement.statistics.shadowRays)/paths<<" shadow rays per path, mean radiance "
+	<<static_cast<double>(measurement.meanRadiance)<<", "<<measurement.seconds<<" seconds\n";
+  }
+}
 
+int main(int argc, char** argv) {
+  std::optional<Options> parsed = parseOptions(argc,argv);
+  if(!parsed.has_value()){
+	return 1;
+  }
+  const Options& options = parsed.value();
 
   //Scene
 
   RandomDevice64 rng(42);
-
-  constexpr auto aspectRatio = 1.0;
-  constexpr int imageWidth = 600;
-  constexpr int imageHeight = static_cast<int>(imageWidth / aspectRatio);
-  auto pair = cornellBox(rng,aspectRatio);
-
-  //Render
-
-  std::atomic<int> completedThreads = 0;
-  std::mutex mutex;
-  std::condition_variable cvResults;
-  std::vector<BlockJob> imageBlocks;
-  std::vector<std::thread> threads;
-  constexpr size_t nThreads = 8;
-
-  //Define the chunks/jobs to be handled
-  std::atomic<size_t> nextJobIndex = 0;
-  std::vector<BlockJob> jobs;
-  //Job for each row: option
-  {
-	for (int row = 0; row < imageHeight; ++row) {
-	  jobs.push_back(BlockJob{
-		  .rowStart = row,
-		  .colStart = 0,
-		  .numRows = 1,
-		  .numCols = imageWidth,
-		  .samplesPerPixel = samplesPerPixel,
-		  .maxDepth = maxDepth,
-		  .device = RandomDevice((uint64_t)(row + 1)),
-		  .colors = std::vector<Vec3r>(imageWidth)
-	  });
+  std::optional<std::pair<Scene,Camera>> loaded;
+  if(options.sceneFile.empty()){
+	SceneBuilder buildScene = findScene(options.sceneName).value();
+	loaded = buildScene(rng,options.render.aspectRatio(),options.bvh);
+  }else{
+	std::string error;
+	loaded = loadSceneFile(options.sceneFile,rng,options.render.aspectRatio(),options.bvh,error);
+	if(!loaded.has_value()){
+	  std::cerr<<"Cannot load "<<options.sceneFile<<": "<<error<<"\n";
+	  return 1;
 	}
   }
-
-  //One job for each thread
-//  {
-//	int intNThreads = nThreads;
-//	int rowsPerThread = imageHeight / intNThreads;
-//	int leftOver = imageHeight % intNThreads;
-//	for (int i = 0; i < intNThreads; ++i) {
-//	  int numRows = i == (intNThreads-1) ? (rowsPerThread+leftOver) : rowsPerThread;
-//	  int numCols = imageWidth;
-//	  jobs.push_back(BlockJob{
-//		  .rowStart = i*rowsPerThread,
-//		  .colStart = 0,
-//		  .numRows = numRows,
-//		  .numCols = numCols,
-//		  .samplesPerPixel = samplesPerPixel,
-//		  .maxDepth = maxDepth,
-//		  .device = RandomDevice((uint64_t)(i + 1)),
-//		  .colors = std::vector<Vec3r>(size_t(numRows*numCols))
-//	  });
-//	}
-//  }
-
-  auto startTime = std::chrono::high_resolution_clock::now();
-
+  auto& [scene,camera] = loaded.value();
   {
-	for (size_t i = 0; i < nThreads; ++i) {
-	  std::thread thread([ pair, &mutex, &cvResults, &completedThreads, &imageBlocks,&nextJobIndex,&jobs]() {
-		runWorkerThread(pair.second, pair.first, imageWidth, imageHeight, mutex, cvResults, completedThreads,
-					nextJobIndex,jobs, imageBlocks);
-	  });
-	  threads.push_back(std::move(thread));
-	}
+	const BVHBuildStatistics& bvhStats = scene.bvhStatistics();
+	std::cerr<<(bvhStats.cached ? "BVH loaded from cache in " : "BVH build took ")<<bvhStats.buildSeconds<<" seconds, SAH cost: "<<bvhStats.sahCost
+	<<", nodes: "<<bvhStats.numNodes<<", leaves: "<<bvhStats.numLeaves<<"\n";
+	std::cerr<<"Precision: "<<(sizeof(Real) == sizeof(float) ? "float" : "double")<<", acceleration structure: "
+	<<static_cast<double>(scene.acceleratorBytes())/(1024.0*1024.0)<<" MiB\n";
   }
-  auto afterThreadLaunchTime = std::chrono::high_resolution_clock::now();
-  //Wait for the image
-  {
-	std::unique_lock<std::mutex> lock(mutex); //Why is this lock needed?
-	cvResults.wait(lock,[&completedThreads](){return completedThreads == nThreads;});
+  Renderer renderer(options.render);
+  if(options.measureTraversal){
+	reportTraversal(renderer.measureTraversal(scene,camera));
   }
-  for(auto& thread : threads){
-	thread.join();
+  if(options.measurePathLength){
+	reportPaths(renderer.measurePaths(scene,camera));
   }
-  auto beforeCopyTime = std::chrono::high_resolution_clock::now();
 
-  std::vector<Vec3r> colorBuffer(imageWidth * imageHeight);
-  for(const auto& job : imageBlocks){
-	for (int jobJ = 0; jobJ < job.numRows ; ++jobJ) {
-	  for (int jobI = 0; jobI < job.numCols; ++jobI) {
-		int totJ = job.rowStart + jobJ;
-		int totI = job.colStart + jobI;
-		colorBuffer[size_t(totJ*imageWidth+totI)] = job.colors[size_t(jobJ*job.numCols+jobI)];
+  //Render
+
+  auto animationStartTime = std::chrono::high_resolution_clock::now();
+  for (int frame = 0; frame < options.frames; ++frame) {
+	if(frame != 0){
+	  auto updateStartTime = std::chrono::high_resolution_clock::now();
+	  bool rebuilt = scene.advance(options.frameTime,rng,options.rebuildThreshold);
+	  auto updateEndTime = std::chrono::high_resolution_clock::now();
+	  std::cerr<<"Frame "<<frame<<": BVH "<<(rebuilt ? "rebuilt" : "refitted")<<" in "
+	  <<std::chrono::duration<double>(updateEndTime-updateStartTime).count()<<" seconds, SAH cost: "
+	  <<scene.bvhStatistics().sahCost<<"\n";
+	}
+	//Tiles finish on the worker threads, so the report is serialized and never goes back to an earlier count
+	std::mutex progressMutex;
+	std::size_t reportedTiles = 0;
+	RenderStatistics statistics = renderer.render(scene,camera,[&](std::size_t completed, std::size_t total){
+	  if(completed % std::max(total / 100,std::size_t(1)) == 0){
+		std::lock_guard<std::mutex> lock(progressMutex);
+		if(completed > reportedTiles){
+		  reportedTiles = completed;
+		  std::cerr<<"finished tile: "<<completed<<"/"<<total<<"\r"<<std::flush;
+		}
 	  }
+	});
+	std::cerr<<"\n";
+
+	//write to file
+	auto writeStartTime = std::chrono::high_resolution_clock::now();
+	std::string imageFile = options.frames > 1 ? frameFileName(options.imageFile,frame) : options.imageFile;
+	if(!writeImage(imageFile.empty() ? nullptr : imageFile.c_str(),options.imageFormat,
+				   renderer.colors(),renderer.sampleCounts())){
+	  std::cerr<<"Cannot write "<<(imageFile.empty() ? "the image to stdout" : imageFile)<<"\n";
+	  return 1;
 	}
-  }
-
-  std::cerr<<"\n";
-  auto endTime = std::chrono::high_resolution_clock::now();
-
-  //write to file
-  std::cout << "P3\n" << imageWidth << ' ' << imageHeight << "\n255\n";
-  for (int j = imageHeight-1 ; j >= 0 ; --j) {
-	for (int i = 0; i < imageWidth; ++i) {
-	  auto index = size_t(j*imageWidth + i);
-	  writeColor(std::cout, colorBuffer[index], samplesPerPixel);
+	auto writeEndTime = std::chrono::high_resolution_clock::now();
+	if(options.render.useAdaptiveSampling && !writeSampleCounts(options.sampleCountFile.c_str(),renderer.sampleCounts())){
+	  std::cerr<<"Cannot write "<<options.sampleCountFile<<"\n";
+	  return 1;
 	}
+	if constexpr(instrumentationEnabled){
+	  reportRenderWork(statistics.work);
+	  std::optional<float> fullScale = writeHeatmap(options.heatmapFile.c_str(),renderer.traversalCost());
+	  if(!fullScale.has_value()){
+		std::cerr<<"Cannot write "<<options.heatmapFile<<"\n";
+		return 1;
+	  }
+	  std::cerr<<"Traversal cost heat map written to "<<options.heatmapFile<<", full brightness at "<<fullScale.value()
+	  <<" nodes and primitives per sample\n";
+	}
+	int tileSize = options.render.tileSize;
+	std::cerr<<"Computation took "<<statistics.seconds<<" seconds with "<<statistics.tiles<<" tiles of "<<tileSize<<"x"
+	<<tileSize<<" pixels on "<<options.render.numThreads<<" threads\n";
+	std::cerr<<"Throughput: "<<static_cast<double>(statistics.samples)/statistics.seconds/1e6<<" Msamples/s, "
+	<<static_cast<double>(statistics.rays)/statistics.seconds/1e6<<" Mrays/s\n";
+	std::cerr<<"Writing the image took "<<std::chrono::duration<double>(writeEndTime-writeStartTime).count()<<" seconds\n";
+  }
+  if(options.frames > 1){
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-animationStartTime).count();
+	std::cerr<<"Animation of "<<options.frames<<" frames took "<<seconds<<" seconds: "
+	<<60.0*options.frames/seconds<<" frames per minute\n";
   }
-  std::cerr<<"Computation took "<<(static_cast<double>((beforeCopyTime-startTime).count())/1e9) <<
-  " seconds, Copying took "<<(static_cast<double>((endTime-beforeCopyTime).count())/1e9)  <<"\n";
-  std::cerr<<"Launching threads took: "<<(static_cast<double>((afterThreadLaunchTime-startTime).count())/1e9)<<" seconds\n";
   return 0;
 }
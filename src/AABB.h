@@ -13,12 +13,12 @@ class AABB{
  public:
   AABB() = default;
   AABB(const AABB& first, const AABB& second) :
-  	min(fmin(first.min.x(),second.min.x()),
-	  	fmin(first.min.y(),second.min.y()),
-	  	fmin(first.min.z(),second.min.z())),
-	max(fmax(first.max.x(),second.max.x()),
-		fmax(first.max.y(),second.max.y()),
-		fmax(first.max.z(),second.max.z())){};
+  	min(std::fmin(first.min.x(),second.min.x()),
+	  	std::fmin(first.min.y(),second.min.y()),
+	  	std::fmin(first.min.z(),second.min.z())),
+	max(std::fmax(first.max.x(),second.max.x()),
+		std::fmax(first.max.y(),second.max.y()),
+		std::fmax(first.max.z(),second.max.z())){};
 
   AABB(const Vec3r& minimum, const Vec3r& maximum) : min{minimum}, max{maximum}{
 	assert(minimum.x() <= maximum.x() && minimum.y() <= maximum.y() && minimum.z() <= maximum.z());
@@ -37,10 +37,63 @@ class AABB{
 	}
 	return true;
   }
+  //Slab test without divisions; tEntry is set to the distance at which the ray enters the box
+  [[nodiscard]] bool hit(const TraversalRay& ray, Real tMin, Real tMax, Real& tEntry) const{
+	for (int a = 0; a < 3; a++) {
+	  Real t0 = ((ray.negative[a] ? max : min)[a] - ray.origin[a]) * ray.invDirection[a];
+	  Real t1 = ((ray.negative[a] ? min : max)[a] - ray.origin[a]) * ray.invDirection[a];
+	  tMin = t0 > tMin ? t0 : tMin;
+	  tMax = t1 < tMax ? t1 : tMax;
+	}
+	tEntry = tMin;
+	return tMin < tMax;
+  }
+  [[nodiscard]] Vec3r minimum() const { return min;}
+  [[nodiscard]] Vec3r maximum() const { return max;}
+  [[nodiscard]] Vec3r centroid() const { return Real(0.5)*(min+max);}
+  [[nodiscard]] Real surfaceArea() const{
+	Vec3r extent = max-min;
+	return Real(2.0)*(extent.x()*extent.y()+extent.y()*extent.z()+extent.z()*extent.x());
+  }
+ private:
+  Vec3r min;
+  Vec3r max;
+};
+
+//Box which moves linearly over the shutter interval, from the box at the opening of the shutter to the box at its
+//closing. Enclosing the boxes of linearly moving objects at both times encloses them at every time in between.
+class MovingAABB{
+ public:
+  MovingAABB() = default;
+  MovingAABB(const AABB& open, const AABB& close, Real shutterTime) : min{open.minimum()}, max{open.maximum()},
+  minVelocity{(close.minimum() - open.minimum()) / shutterTime}, maxVelocity{(close.maximum() - open.maximum()) / shutterTime}{}
+
+  //Slab test against the box at the time of the ray; tEntry is set to the distance at which the ray enters it
+  [[nodiscard]] bool hit(const TraversalRay& ray, Real timeOffset, Real tMin, Real tMax, Real& tEntry) const{
+	for (int a = 0; a < 3; a++) {
+	  Real minPlane = min[a] + timeOffset * minVelocity[a];
+	  Real maxPlane = max[a] + timeOffset * maxVelocity[a];
+	  Real t0 = ((ray.negative[a] ? maxPlane : minPlane) - ray.origin[a]) * ray.invDirection[a];
+	  Real t1 = ((ray.negative[a] ? minPlane : maxPlane) - ray.origin[a]) * ray.invDirection[a];
+	  tMin = t0 > tMin ? t0 : tMin;
+	  tMax = t1 < tMax ? t1 : tMax;
+	}
+	tEntry = tMin;
+	return tMin < tMax;
+  }
+  [[nodiscard]] bool moving() const{
+	return minVelocity.squaredNorm() + maxVelocity.squaredNorm() > 0;
+  }
+  //Bounds at the opening of the shutter
   [[nodiscard]] Vec3r minimum() const { return min;}
   [[nodiscard]] Vec3r maximum() const { return max;}
+  //Change of the bounds per unit of time
+  [[nodiscard]] Vec3r minimumVelocity() const { return minVelocity;}
+  [[nodiscard]] Vec3r maximumVelocity() const { return maxVelocity;}
  private:
   Vec3r min;
   Vec3r max;
+  Vec3r minVelocity;
+  Vec3r maxVelocity;
 };
 #endif //RAYTRACING_SRC_AABB_H_
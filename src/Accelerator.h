@@ -0,0 +1,67 @@
+#ifndef RAYTRACING_SRC_ACCELERATOR_H_
+#define RAYTRACING_SRC_ACCELERATOR_H_
+
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+#include "BoundingVolumeHierarchy.h"
+#include "WideBoundingVolumeHierarchy.h"
+#include "BVHCache.h"
+
+enum class BVHLayout : int{
+  Binary,
+  Wide4,
+  Wide8
+};
+
+//How scenes and instanced geometry build their acceleration structures
+struct BVHSettings{
+  BVHBuildMethod buildMethod = BVHBuildMethod::ParallelBinnedSAH;
+  BVHLayout layout = BVHLayout::Wide4;
+  //Hierarchies built by the SAH builders are stored in and reused from this directory, unless it is empty
+  std::string cacheDirectory;
+  //Keep the binary hierarchy next to a wide layout, so Scene::advance can refit it instead of building a new one
+  bool refittable = false;
+};
+
+using Accelerator = std::variant<BVH,BVH4,BVH8>;
+
+//Builds, or restores from the cache, a binary hierarchy over the objects
+inline BVH buildHierarchy(const std::vector<BVHObject>& objects, Real shutterTime, RandomDevice& device,
+				   const BVHSettings& settings){
+  //The median builder draws random numbers, so only the deterministic SAH builds are cached
+  bool useCache = !settings.cacheDirectory.empty() && settings.buildMethod != BVHBuildMethod::RandomAxisMedian;
+  std::uint64_t cacheKey = 0;
+  std::string cachePath;
+  std::optional<BVH> cached;
+  if(useCache){
+	cacheKey = bvhCacheKey(objects,shutterTime,settings.buildMethod);
+	cachePath = bvhCachePath(settings.cacheDirectory,cacheKey);
+	cached = loadBVHCache(cachePath,cacheKey,objects,shutterTime);
+  }
+  BVH bvh = cached.has_value() ? std::move(cached.value()) : BVH(objects,shutterTime,device,settings.buildMethod);
+  if(useCache && !cached.has_value()){
+	//A cache which cannot be written only costs the next run a rebuild
+	(void) writeBVHCache(cachePath,cacheKey,bvh);
+  }
+  return bvh;
+}
+
+//The hierarchy in the given layout. Wide layouts are collapsed from the binary tree.
+inline Accelerator acceleratorLayout(BVH bvh, BVHLayout layout){
+  switch(layout){
+	case BVHLayout::Binary: return bvh;
+	case BVHLayout::Wide4: return BVH4(bvh);
+	case BVHLayout::Wide8: return BVH8(bvh);
+  }
+  return bvh;
+}
+
+//Builds, or restores from the cache, a hierarchy over the objects in the layout given by settings
+inline Accelerator buildAccelerator(const std::vector<BVHObject>& objects, Real shutterTime, RandomDevice& device,
+							 const BVHSettings& settings){
+  return acceleratorLayout(buildHierarchy(objects,shutterTime,device,settings),settings.layout);
+}
+
+#endif //RAYTRACING_SRC_ACCELERATOR_H_
@@ -0,0 +1,210 @@
+#ifndef RAYTRACING_SRC_BVHCACHE_H_
+#define RAYTRACING_SRC_BVHCACHE_H_
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "BoundingVolumeHierarchy.h"
+#include "MappedFile.h"
+
+//Built hierarchies stored on disk, so that renders of unchanged geometry skip the build. A cache file holds the
+//binary nodes and the leaf order of the objects, which are indices into the objects of the scene, so the geometry
+//itself always comes from the scene. Files are named after a key which hashes everything the SAH builders depend on.
+constexpr std::array<char,8> bvhCacheMagic = {'R','T','B','V','H','\0','\0','\0'};
+constexpr std::uint32_t bvhCacheVersion = 2;
+constexpr std::size_t bvhCacheAlignment = 64;
+
+struct BVHCacheHeader{
+  std::array<char,8> magic;
+  std::uint32_t version;
+  std::uint32_t nodeBytes; //sizeof(BVHNode) of the writing build
+  std::uint64_t key;
+  std::uint64_t numNodes;
+  std::uint64_t nodeOffset;
+  std::uint64_t numObjects;
+  std::uint64_t orderOffset;
+  BVHIndex root;
+  std::uint32_t padding;
+};
+
+static_assert(std::is_trivially_copyable_v<BVHNode>,"Nodes are written and mapped as raw bytes");
+
+//64 bit hash of a sequence of values, fed field by field so padding bytes never take part
+class ContentHash{
+ public:
+  void add(std::uint64_t value){
+	value *= 0x9E3779B97F4A7C15ULL;
+	value ^= value >> 29;
+	state = (state ^ value) * 0x100000001B3ULL;
+  }
+  void add(Real value){
+	add(std::uint64_t(std::bit_cast<RealBits>(value)));
+  }
+  void add(const Vec3r& vec){
+	add(vec.x());
+	add(vec.y());
+	add(vec.z());
+  }
+  [[nodiscard]] std::uint64_t value() const{ return state;}
+ private:
+  using RealBits = std::conditional_t<sizeof(Real) == sizeof(std::uint32_t),std::uint32_t,std::uint64_t>;
+  std::uint64_t state = 0xCBF29CE484222325ULL;
+};
+
+//Hashes the objects in the order they are passed to the builder, together with the build parameters
+inline std::uint64_t bvhCacheKey(const std::vector<BVHObject>& objects, Real offsetTime, BVHBuildMethod method){
+  ContentHash hash;
+  hash.add(std::uint64_t(bvhCacheVersion));
+  hash.add(std::uint64_t(sizeof(Real)));
+  hash.add(std::uint64_t(method));
+  hash.add(offsetTime);
+  hash.add(std::uint64_t(SAHSettings::numBins));
+  hash.add(std::uint64_t(SAHSettings::maxLeafSize));
+  hash.add(SAHSettings::traversalCost);
+  hash.add(SAHSettings::intersectionCost);
+  hash.add(std::uint64_t(objects.size()));
+  for(const BVHObject& object : objects){
+	object.hashContent(hash);
+  }
+  return hash.value();
+}
+
+inline std::string bvhCachePath(const std::string& directory, std::uint64_t key){
+  std::array<char,16> digits{};
+  auto [end, error] = std::to_chars(digits.data(),digits.data()+digits.size(),key,16);
+  return (std::filesystem::path(directory) / (std::string(digits.data(),end) + ".bvh")).string();
+}
+
+//Returns false when the file cannot be written. The file is written under a temporary name and renamed,
+//so renders running at the same time never map a partially written file.
+inline bool writeBVHCache(const std::string& path, std::uint64_t key, const BVH& bvh){
+  const std::vector<BVHNode>& nodes = bvh.nodeList();
+  const std::vector<std::uint32_t>& order = bvh.objectOrder();
+  BVHCacheHeader header{
+	.magic = bvhCacheMagic,
+	.version = bvhCacheVersion,
+	.nodeBytes = sizeof(BVHNode),
+	.key = key,
+	.numNodes = nodes.size(),
+	.nodeOffset = bvhCacheAlignment,
+	.numObjects = order.size(),
+	.orderOffset = 0,
+	.root = bvh.rootIndex(),
+	.padding = 0
+  };
+  header.orderOffset = (header.nodeOffset + nodes.size() * sizeof(BVHNode) + bvhCacheAlignment - 1) /
+	  bvhCacheAlignment * bvhCacheAlignment;
+  static_assert(sizeof(BVHCacheHeader) <= bvhCacheAlignment);
+
+  std::error_code error;
+  std::filesystem::create_directories(std::filesystem::path(path).parent_path(),error);
+  std::string temporaryPath = path + ".tmp" + std::to_string(::getpid());
+  std::ofstream file(temporaryPath,std::ios::binary);
+  std::uint64_t position = 0;
+  auto writeSection = [&](std::uint64_t offset, const void* data, std::size_t bytes){
+	static constexpr std::array<char,bvhCacheAlignment> zeros{};
+	file.write(zeros.data(),static_cast<std::streamsize>(offset - position));
+	file.write(static_cast<const char*>(data),static_cast<std::streamsize>(bytes));
+	position = offset + bytes;
+  };
+  writeSection(0,&header,sizeof(BVHCacheHeader));
+  writeSection(header.nodeOffset,nodes.data(),nodes.size() * sizeof(BVHNode));
+  writeSection(header.orderOffset,order.data(),order.size() * sizeof(std::uint32_t));
+  file.close();
+  if(!file){
+	std::filesystem::remove(temporaryPath,error);
+	return false;
+  }
+  std::filesystem::rename(temporaryPath,path,error);
+  return !error;
+}
+
+//Restores the hierarchy stored under path if it was built with the given key for these objects. A missing, stale
+//or damaged file returns nothing, in which case the hierarchy has to be built.
+inline std::optional<BVH> loadBVHCache(const std::string& path, std::uint64_t key, const std::vector<BVHObject>& objects,
+								Real offsetTime){
+  std::shared_ptr<const MappedFile> file = MappedFile::open(path);
+  if(!file){
+	return std::nullopt;
+  }
+  std::span<const std::byte> bytes = file->bytes();
+  BVHCacheHeader header{};
+  if(bytes.size() < sizeof(BVHCacheHeader)){
+	return std::nullopt;
+  }
+  std::memcpy(&header,bytes.data(),sizeof(BVHCacheHeader));
+  if(header.magic != bvhCacheMagic || header.version != bvhCacheVersion || header.nodeBytes != sizeof(BVHNode) ||
+	  header.key != key || header.numObjects != objects.size() || header.numNodes >= INVALID_INDEX ||
+	  header.root >= header.numNodes){
+	return std::nullopt;
+  }
+  auto sectionFits = [&](std::uint64_t offset, std::uint64_t count, std::uint64_t recordBytes){
+	return offset % bvhCacheAlignment == 0 && offset <= bytes.size() && count <= (bytes.size() - offset) / recordBytes;
+  };
+  if(!sectionFits(header.nodeOffset,header.numNodes,sizeof(BVHNode)) ||
+	  !sectionFits(header.orderOffset,header.numObjects,sizeof(std::uint32_t))){
+	return std::nullopt;
+  }
+  //The mapping starts on a page boundary and the sections on 64 byte boundaries, so the records are aligned
+  std::span<const BVHNode> nodes(reinterpret_cast<const BVHNode*>(bytes.data() + header.nodeOffset),header.numNodes);
+  std::span<const std::uint32_t> order(reinterpret_cast<const std::uint32_t*>(bytes.data() + header.orderOffset),
+									   header.numObjects);
+
+  //Traversal trusts the indices, so check them before they are used
+  std::vector<bool> seen(objects.size(),false);
+  for(std::uint32_t object : order){
+	if(object >= objects.size() || seen[object]){
+	  return std::nullopt;
+	}
+	seen[object] = true;
+  }
+  //Every child precedes and names its parent and the root is nobody's child, so the nodes reachable from the root
+  //form a tree, which can be processed bottom up in the order of the nodes
+  auto validChild = [&](BVHIndex child, BVHIndex parent){
+	return child < parent && child != header.root && nodes[child].parent() == parent;
+  };
+  for (BVHIndex index = 0; index < nodes.size(); ++index) {
+	const BVHNode& node = nodes[index];
+	if(node.type() == BVHNodeType::Leaf){
+	  if(std::uint64_t(node.leftChild()) + node.rightChild() > objects.size()){
+		return std::nullopt;
+	  }
+	  auto leafBegin = order.begin() + node.leftChild();
+	  if(!std::is_sorted(leafBegin,leafBegin + node.rightChild(),[&objects](std::uint32_t first, std::uint32_t second){
+		return objects[first].primitiveType() < objects[second].primitiveType();
+	  })){
+		return std::nullopt;
+	  }
+	}else if(node.leftChild() == node.rightChild() || !validChild(node.leftChild(),index) ||
+		!validChild(node.rightChild(),index)){
+	  return std::nullopt;
+	}
+  }
+  //The traversal stacks only fit hierarchies of at most maxBVHDepth levels. Parents follow their children, so the
+  //levels are known top down.
+  std::vector<int> level(nodes.size(),1);
+  for (BVHIndex index = BVHIndex(nodes.size()); index-- > 0;) {
+	const BVHNode& node = nodes[index];
+	if(node.type() == BVHNodeType::Node){
+	  if(level[index] >= maxBVHDepth){
+		return std::nullopt;
+	  }
+	  level[node.leftChild()] = level[index] + 1;
+	  level[node.rightChild()] = level[index] + 1;
+	}
+  }
+  return BVH(nodes,header.root,order,objects,offsetTime);
+}
+
+#endif //RAYTRACING_SRC_BVHCACHE_H_
@@ -8,20 +8,89 @@
 #include <variant>
 #include <vector>
 #include <span>
+#include <array>
+#include <cstdint>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <execution>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/parallel_reduce.h>
 
 #include "AABB.h"
+#include "RayPacket.h"
 #include "Random.h"
 #include "Sphere.h"
 #include "Rectangle.h"
+#include "Triangle.h"
+#include "PrimitiveArrays.h"
 
 using BVHIndex = u_int32_t;
 constexpr BVHIndex INVALID_INDEX = std::numeric_limits<BVHIndex>::max();
+//Most levels a hierarchy may have. The builders keep below it so the traversal stacks can be fixed size arrays.
+constexpr int maxBVHDepth = 64;
 
 enum class BVHNodeType : int{
   Node,
   Leaf
 };
 
+enum class BVHBuildMethod : int{
+  RandomAxisMedian,
+  BinnedSAH,
+  ParallelBinnedSAH //Same splits as BinnedSAH, built with TBB tasks
+};
+
+//Cost model of the binned SAH builder. Costs are relative, only their ratio matters.
+struct SAHSettings{
+  static constexpr std::size_t numBins = 16;
+  static constexpr Real traversalCost = 1.0;
+  static constexpr Real intersectionCost = 1.0;
+  static constexpr long maxLeafSize = 8;
+  //Ranges smaller than this are built serially by the parallel builder
+  static constexpr long parallelThreshold = 4096;
+};
+
+struct BVHBuildStatistics{
+  double buildSeconds = 0.0;
+  Real sahCost = 0.0;
+  std::size_t numNodes = 0;
+  std::size_t numLeaves = 0;
+  bool cached = false; //Restored from a BVH cache instead of built
+  bool refitted = false; //Boxes recomputed by BVH::refit, the topology is that of an earlier build
+};
+
+//Work done by traversal kernels, accumulated over all rays passed to them
+struct TraversalCounters{
+  uint64_t rays = 0;
+  uint64_t boxTests = 0;
+  uint64_t nodesVisited = 0; //Nodes whose box was hit and whose children or objects were processed
+  uint64_t leavesVisited = 0;
+  uint64_t primitiveTests = 0;
+  uint64_t hits = 0; //Rays which hit a primitive, counted by Scene
+
+  TraversalCounters& operator+=(const TraversalCounters& other){
+	rays += other.rays;
+	boxTests += other.boxTests;
+	nodesVisited += other.nodesVisited;
+	leavesVisited += other.leavesVisited;
+	primitiveTests += other.primitiveTests;
+	hits += other.hits;
+	return *this;
+  }
+};
+
+//Bounds of an object, computed once before a build so the builder does not recompute them
+struct BVHBuildPrimitive{
+  AABB box;
+  Vec3r centroid;
+  std::size_t object;
+};
+
 class BVHObject{
  public:
   template<typename X> BVHObject(X x) : object{x}{};
@@ -29,18 +98,53 @@ class BVHObject{
   [[nodiscard]] AABB boundingBox(Real offsetTime) const{
 	return std::visit(
 		overload{[&offsetTime](const SphereData &obj) -> AABB { return obj.boundingBox(offsetTime); },
-				 [](const AARectangleData& obj) -> AABB {return obj.boundingBox();}
+				 [](const AARectangleData& obj) -> AABB {return obj.boundingBox();},
+				 [](const MeshTriangle& obj) -> AABB {return obj.boundingBox();},
+				 [](const Instance* obj) -> AABB {return obj->boundingBox();}
+		}
+		,object);
+  }
+  //Bounds at a single time, which only differ from the bounds at other times for moving spheres
+  [[nodiscard]] AABB boundingBoxAt(Real timeOffset) const{
+	return std::visit(
+		overload{[&timeOffset](const SphereData &obj) -> AABB { return obj.boundingBoxAt(timeOffset); },
+				 [](const AARectangleData& obj) -> AABB {return obj.boundingBox();},
+				 [](const MeshTriangle& obj) -> AABB {return obj.boundingBox();},
+				 [](const Instance* obj) -> AABB {return obj->boundingBox();}
 		}
 		,object);
   }
   [[nodiscard]] std::optional<HitRecord> hit(const Ray& ray, Real tMin, Real tMax) const{
 	return std::visit(overload{
 	  [&](const SphereData& obj) {return obj.hit(ray,tMin,tMax);},
-	  [&](const AARectangleData& obj) {return obj.hit(ray,tMin,tMax);}
+	  [&](const AARectangleData& obj) {return obj.hit(ray,tMin,tMax);},
+	  [&](const MeshTriangle& obj) {return obj.hit(ray,tMin,tMax);},
+	  [&](const Instance* obj) {return obj->hit(ray,tMin,tMax);}
 	  },object);
   }
+  //Leaves list their objects in increasing order of this: spheres, rectangles, triangles, instances.
+  //See PrimitiveArrays.
+  [[nodiscard]] std::size_t primitiveType() const{
+	return object.index();
+  }
+  void addTo(PrimitiveArrays& arrays) const{
+	std::visit(overload{
+	  [&arrays](const Instance* obj){ arrays.push_back(*obj);},
+	  [&arrays](const auto& obj){ arrays.push_back(obj);}
+	},object);
+  }
+  template<typename Hash>
+  void hashContent(Hash& hash) const{
+	hash.add(std::uint64_t(object.index()));
+	std::visit(overload{
+	  [&hash](const Instance* obj){ obj->hashContent(hash);},
+	  [&hash](const auto& obj){ obj.hashContent(hash);}
+	},object);
+  }
  private:
-  std::variant<SphereData,AARectangleData> object; //TODO: keep data here or just a pointer?
+  //Instances are much larger than the primitives and are kept by the scene, so they are referenced. Triangles
+  //refer to the mesh they are a face of.
+  std::variant<SphereData,AARectangleData,MeshTriangle,const Instance*> object; //TODO: keep data here or just a pointer?
 };
 
 class BVHObjectList{
@@ -65,21 +169,19 @@ class BVHObjectList{
 class BVHNode{
  public:
 
-  static BVHIndex populate(std::vector<BVHObject>& objects,
+  static BVHIndex populate(std::vector<BVHBuildPrimitive>& primitives,
 						   long beginIndex,long endIndex,
-				std::vector<BVHNode>& nodes, Real offsetTime,
+				std::vector<BVHNode>& nodes,
 				RandomDevice& device){
 
 	int axis = device.randomUInt() % 3;
 
-	auto objBegin = objects.begin()+beginIndex;
-	auto objEnd = objects.begin()+endIndex;
+	auto primBegin = primitives.begin()+beginIndex;
+	auto primEnd = primitives.begin()+endIndex;
 
-	std::sort(objBegin, objEnd,
-			  [axis,offsetTime](const BVHObject& a, const BVHObject& b) -> bool {
-	  AABB leftBox = a.boundingBox(offsetTime);
-	  AABB rightBox = b.boundingBox(offsetTime);
-	  return leftBox.minimum()[axis] < rightBox.minimum()[axis];
+	std::sort(primBegin, primEnd,
+			  [axis](const BVHBuildPrimitive& a, const BVHBuildPrimitive& b) -> bool {
+	  return a.box.minimum()[axis] < b.box.minimum()[axis];
 	});
 
 	long size = endIndex-beginIndex;
@@ -92,11 +194,11 @@ class BVHNode{
 	  node.left = BVHIndex(beginIndex);
 	  node.right = BVHIndex(endIndex-beginIndex);
 	  {
-		auto it = objects.begin()+beginIndex;
-		AABB surroundingBoundingBox = it->boundingBox(offsetTime);
+		auto it = primBegin;
+		AABB surroundingBoundingBox = it->box;
 		++it;
-		while(it != (objects.begin()+endIndex)){
-		  surroundingBoundingBox = AABB(surroundingBoundingBox,it->boundingBox(offsetTime));
+		while(it != primEnd){
+		  surroundingBoundingBox = AABB(surroundingBoundingBox,it->box);
 		  ++it;
 		}
 		node.aabb = surroundingBoundingBox;
@@ -112,8 +214,8 @@ class BVHNode{
 
 	  BVHNode node;
 	  node.nodeType = BVHNodeType::Node;
-	  node.left = populate(objects,beginIndex,splitIndex,nodes,offsetTime,device);
-	  node.right = populate(objects,splitIndex,endIndex,nodes,offsetTime,device);
+	  node.left = populate(primitives,beginIndex,splitIndex,nodes,device);
+	  node.right = populate(primitives,splitIndex,endIndex,nodes,device);
 	  node.aabb = AABB(nodes[node.left].aabb,nodes[node.right].aabb);
 
 	  BVHIndex index = static_cast<BVHIndex>(nodes.size());
@@ -124,12 +226,224 @@ class BVHNode{
 	}
   }
 
+  static BVHIndex populateSAH(std::vector<BVHBuildPrimitive>& primitives,
+							  long beginIndex, long endIndex,
+							  std::vector<BVHNode>& nodes, std::atomic<BVHIndex>& numNodes,
+							  bool parallel, int depth = 0){
+	auto primBegin = primitives.begin()+beginIndex;
+	auto primEnd = primitives.begin()+endIndex;
+
+	long size = endIndex-beginIndex;
+	//Small subtrees are not worth the task overhead
+	parallel = parallel && size >= SAHSettings::parallelThreshold;
+
+	auto [bounds,centroidBounds] = parallel ?
+		tbb::parallel_reduce(tbb::blocked_range<long>(beginIndex,endIndex),
+							 std::make_pair(primBegin->box,AABB(primBegin->centroid,primBegin->centroid)),
+							 [&primitives](const tbb::blocked_range<long>& range, std::pair<AABB,AABB> result){
+							   return primitiveBounds(primitives,range.begin(),range.end(),result);
+							 },
+							 [](const std::pair<AABB,AABB>& first, const std::pair<AABB,AABB>& second){
+							   return std::make_pair(AABB(first.first,second.first),AABB(first.second,second.second));
+							 }) :
+		primitiveBounds(primitives,beginIndex,endIndex,
+						std::make_pair(primBegin->box,AABB(primBegin->centroid,primBegin->centroid)));
+
+	if(size == 1){
+	  return makeLeaf(beginIndex,endIndex,bounds,nodes,numNodes);
+	}
+
+	constexpr std::size_t numBins = SAHSettings::numBins;
+	auto binIndex = [&centroidBounds](const Vec3r& centroid, int axis) -> std::size_t{
+	  Real minimum = centroidBounds.minimum()[axis];
+	  Real extent = centroidBounds.maximum()[axis] - minimum;
+	  if(extent <= Real(0.0)){
+		return 0;
+	  }
+	  auto bin = static_cast<std::size_t>(Real(numBins) * (centroid[axis] - minimum) / extent);
+	  return std::min(bin,numBins-1);
+	};
+	auto fillBins = [&](long begin, long end, SAHBins bins){
+	  for (long i = begin; i < end; ++i) {
+		const BVHBuildPrimitive& primitive = primitives[std::size_t(i)];
+		for (int axis = 0; axis < 3; ++axis) {
+		  SAHBin& bin = bins[std::size_t(axis)][binIndex(primitive.centroid,axis)];
+		  bin.box = bin.count == 0 ? primitive.box : AABB(bin.box,primitive.box);
+		  bin.count++;
+		}
+	  }
+	  return bins;
+	};
+	SAHBins bins = parallel ?
+		tbb::parallel_reduce(tbb::blocked_range<long>(beginIndex,endIndex),SAHBins{},
+							 [&fillBins](const tbb::blocked_range<long>& range, SAHBins result){
+							   return fillBins(range.begin(),range.end(),result);
+							 },
+							 mergeBins) :
+		fillBins(beginIndex,endIndex,SAHBins{});
+
+	Real leafCost = SAHSettings::intersectionCost * Real(size);
+	Real bestCost = std::numeric_limits<Real>::infinity();
+	int bestAxis = -1;
+	std::size_t bestBin = 0;
+
+	Real boundsArea = bounds.surfaceArea();
+	Real invBoundsArea = boundsArea > Real(0.0) ? Real(1.0) / boundsArea : Real(0.0);
+
+	for (int axis = 0; axis < 3; ++axis) {
+	  if(centroidBounds.maximum()[axis] <= centroidBounds.minimum()[axis]){
+		continue;
+	  }
+	  const auto& axisBins = bins[std::size_t(axis)];
+
+	  //Sweep from the right to get the area and count right of every split plane
+	  std::array<Real,numBins> rightArea{};
+	  std::array<long,numBins> rightCount{};
+	  {
+		AABB box;
+		long count = 0;
+		for (std::size_t i = numBins-1; i > 0; --i) {
+		  if(axisBins[i].count != 0){
+			box = count == 0 ? axisBins[i].box : AABB(box,axisBins[i].box);
+			count += axisBins[i].count;
+		  }
+		  rightArea[i] = count == 0 ? Real(0.0) : box.surfaceArea();
+		  rightCount[i] = count;
+		}
+	  }
+	  //Split i puts bins [0,i) on the left and [i,numBins) on the right
+	  AABB box;
+	  long count = 0;
+	  for (std::size_t i = 1; i < numBins; ++i) {
+		if(axisBins[i-1].count != 0){
+		  box = count == 0 ? axisBins[i-1].box : AABB(box,axisBins[i-1].box);
+		  count += axisBins[i-1].count;
+		}
+		if(count == 0 || rightCount[i] == 0){
+		  continue;
+		}
+		Real cost = SAHSettings::traversalCost + SAHSettings::intersectionCost * invBoundsArea *
+			(Real(count) * box.surfaceArea() + Real(rightCount[i]) * rightArea[i]);
+		if(cost < bestCost){
+		  bestCost = cost;
+		  bestAxis = axis;
+		  bestBin = i;
+		}
+	  }
+	}
+
+	//Skewed scenes can make the SAH peel off a few objects at a time. Once a balanced split is the only way to stay
+	//within maxBVHDepth, halve the objects instead; the children then keep doing so down to the leaves.
+	bool balanced = depth + std::bit_width(std::size_t(size)) >= maxBVHDepth;
+	long splitIndex;
+	if(balanced){
+	  if(size <= SAHSettings::maxLeafSize){
+		return makeLeaf(beginIndex,endIndex,bounds,nodes,numNodes);
+	  }
+	  Vec3r extent = centroidBounds.maximum() - centroidBounds.minimum();
+	  int axis = extent.x() >= extent.y() ? (extent.x() >= extent.z() ? 0 : 2) : (extent.y() >= extent.z() ? 1 : 2);
+	  splitIndex = beginIndex + size/2;
+	  auto byCentroid = [axis](const BVHBuildPrimitive& a, const BVHBuildPrimitive& b){
+		return a.centroid[axis] < b.centroid[axis];
+	  };
+	  auto splitPrimitive = primitives.begin() + splitIndex;
+	  if(parallel){
+		std::nth_element(std::execution::par,primBegin,splitPrimitive,primEnd,byCentroid);
+	  }else{
+		std::nth_element(primBegin,splitPrimitive,primEnd,byCentroid);
+	  }
+	}else if(bestAxis == -1){
+	  //All centroids coincide, so no split plane separates the objects
+	  if(size <= SAHSettings::maxLeafSize){
+		return makeLeaf(beginIndex,endIndex,bounds,nodes,numNodes);
+	  }
+	  splitIndex = beginIndex + size/2;
+	}else{
+	  if(bestCost >= leafCost && size <= SAHSettings::maxLeafSize){
+		return makeLeaf(beginIndex,endIndex,bounds,nodes,numNodes);
+	  }
+	  auto isLeft = [&](const BVHBuildPrimitive& primitive){
+		return binIndex(primitive.centroid,bestAxis) < bestBin;
+	  };
+	  auto split = parallel ? std::partition(std::execution::par,primBegin,primEnd,isLeft) :
+				   std::partition(primBegin,primEnd,isLeft);
+	  splitIndex = beginIndex + (split - primBegin);
+	}
+
+	assert(splitIndex != beginIndex && splitIndex != endIndex);
+
+	BVHNode node;
+	node.nodeType = BVHNodeType::Node;
+	if(parallel){
+	  tbb::parallel_invoke(
+		  [&](){ node.left = populateSAH(primitives,beginIndex,splitIndex,nodes,numNodes,true,depth+1);},
+		  [&](){ node.right = populateSAH(primitives,splitIndex,endIndex,nodes,numNodes,true,depth+1);});
+	}else{
+	  node.left = populateSAH(primitives,beginIndex,splitIndex,nodes,numNodes,false,depth+1);
+	  node.right = populateSAH(primitives,splitIndex,endIndex,nodes,numNodes,false,depth+1);
+	}
+	node.aabb = bounds;
+
+	BVHIndex index = numNodes++;
+	nodes[node.left].parentIdx = index;
+	nodes[node.right].parentIdx = index;
+	nodes[index] = node;
+	return index;
+  }
+
+  //Stores a leaf over the primitives [beginIndex,endIndex) in the next free slot of nodes
+  static BVHIndex makeLeaf(long beginIndex, long endIndex, const AABB& bounds,
+						   std::vector<BVHNode>& nodes, std::atomic<BVHIndex>& numNodes){
+	BVHNode node;
+	node.nodeType = BVHNodeType::Leaf;
+	node.left = BVHIndex(beginIndex);
+	node.right = BVHIndex(endIndex-beginIndex);
+	node.aabb = bounds;
+
+	BVHIndex index = numNodes++;
+	nodes[index] = node;
+	return index;
+  }
+
   [[nodiscard]] const AABB& box() const {return aabb;}
   [[nodiscard]] BVHIndex parent() const {return parentIdx;}
   [[nodiscard]] BVHIndex leftChild() const {return left;}
   [[nodiscard]] BVHIndex rightChild() const {return right;}
   [[nodiscard]] BVHNodeType type() const {return nodeType;}
+  void setBox(const AABB& box) {aabb = box;}
  private:
+  struct SAHBin{
+	AABB box;
+	long count = 0;
+  };
+  using SAHBins = std::array<std::array<SAHBin,SAHSettings::numBins>,3>;
+
+  static SAHBins mergeBins(const SAHBins& first, const SAHBins& second){
+	SAHBins result = first;
+	for (std::size_t axis = 0; axis < 3; ++axis) {
+	  for (std::size_t i = 0; i < SAHSettings::numBins; ++i) {
+		const SAHBin& other = second[axis][i];
+		SAHBin& bin = result[axis][i];
+		if(other.count != 0){
+		  bin.box = bin.count == 0 ? other.box : AABB(bin.box,other.box);
+		  bin.count += other.count;
+		}
+	  }
+	}
+	return result;
+  }
+
+  //Returns the union of the given bounds with the boxes and centroids of primitives [begin,end)
+  static std::pair<AABB,AABB> primitiveBounds(const std::vector<BVHBuildPrimitive>& primitives,
+											  long begin, long end, std::pair<AABB,AABB> bounds){
+	for (long i = begin; i < end; ++i) {
+	  const BVHBuildPrimitive& primitive = primitives[std::size_t(i)];
+	  bounds.first = AABB(bounds.first,primitive.box);
+	  bounds.second = AABB(bounds.second,AABB(primitive.centroid,primitive.centroid));
+	}
+	return bounds;
+  }
+
   AABB aabb;
   BVHNodeType nodeType;
   BVHIndex left;
@@ -141,11 +455,196 @@ class BVHNode{
 class BVH{
  public:
   BVH() = default;
-  explicit BVH(std::vector<BVHObject> inObjects, Real offsetTime,RandomDevice& device) : objects(std::move(inObjects)){
-	root = BVHNode::populate(objects,0,long(objects.size()),nodes,offsetTime,device);
+  explicit BVH(const std::vector<BVHObject>& objects, Real offsetTime,RandomDevice& device,
+			   BVHBuildMethod method = BVHBuildMethod::ParallelBinnedSAH){
+	auto startTime = std::chrono::high_resolution_clock::now();
+	if(objects.empty()){
+	  //A single leaf without objects, which no ray can hit
+	  nodes.resize(1);
+	  std::atomic<BVHIndex> numNodes = 0;
+	  root = BVHNode::makeLeaf(0,0,AABB(Vec3r(0,0,0),Vec3r(0,0,0)),nodes,numNodes);
+	  finishBuild(objects,offsetTime,startTime);
+	  return;
+	}
+	bool parallel = method == BVHBuildMethod::ParallelBinnedSAH;
+	std::vector<BVHBuildPrimitive> buildPrimitives(objects.size());
+	auto computePrimitive = [&](std::size_t i){
+	  AABB box = objects[i].boundingBox(offsetTime);
+	  buildPrimitives[i] = BVHBuildPrimitive{.box = box,.centroid = box.centroid(),.object = i};
+	};
+	if(parallel){
+	  tbb::parallel_for(std::size_t(0),objects.size(),computePrimitive);
+	}else{
+	  for (std::size_t i = 0; i < objects.size(); ++i) {
+		computePrimitive(i);
+	  }
+	}
+	switch(method){
+	  case BVHBuildMethod::RandomAxisMedian:{
+		root = BVHNode::populate(buildPrimitives,0,long(buildPrimitives.size()),nodes,device);
+	  } break;
+	  case BVHBuildMethod::BinnedSAH:
+	  case BVHBuildMethod::ParallelBinnedSAH:{
+		//A binary tree with at most one object per leaf has at most 2n-1 nodes
+		nodes.resize(2*objects.size()-1);
+		std::atomic<BVHIndex> numNodes = 0;
+		root = BVHNode::populateSAH(buildPrimitives,0,long(buildPrimitives.size()),nodes,numNodes,parallel);
+		nodes.resize(numNodes);
+		nodes.shrink_to_fit();
+	  } break;
+	}
+	//The leaves reference contiguous ranges of the objects in the order the builder left the primitives in
+	order.resize(objects.size());
+	for (std::size_t i = 0; i < objects.size(); ++i) {
+	  order[i] = static_cast<std::uint32_t>(buildPrimitives[i].object);
+	}
+	//Within every leaf, group the objects by type so each type forms one contiguous range
+	for(const auto& node : nodes){
+	  if(node.type() == BVHNodeType::Leaf){
+		auto leafBegin = order.begin() + node.leftChild();
+		std::stable_sort(leafBegin,leafBegin + node.rightChild(),[&objects](std::uint32_t first, std::uint32_t second){
+		  return objects[first].primitiveType() < objects[second].primitiveType();
+		});
+	  }
+	}
+	finishBuild(objects,offsetTime,startTime);
   };
+  //Restores a hierarchy built earlier from its nodes and object order, see objectOrder()
+  BVH(std::span<const BVHNode> nodeList, BVHIndex rootIndex, std::span<const std::uint32_t> objectOrder,
+	  const std::vector<BVHObject>& objects, Real offsetTime) : root{rootIndex}, nodes(nodeList.begin(),nodeList.end()),
+	  order(objectOrder.begin(),objectOrder.end()){
+	finishBuild(objects,offsetTime,std::chrono::high_resolution_clock::now());
+	statistics.cached = true;
+  }
 
-  [[nodiscard]] std::optional<HitRecord> hit(const Ray& ray, Real tMin, Real tMax) const{
+  [[nodiscard]] const BVHBuildStatistics& buildStatistics() const {return statistics;}
+  [[nodiscard]] BVHIndex rootIndex() const {return root;}
+  [[nodiscard]] const std::vector<BVHNode>& nodeList() const {return nodes;}
+  //Index of the input object at every position of the leaf ranges
+  [[nodiscard]] const std::vector<std::uint32_t>& objectOrder() const {return order;}
+  [[nodiscard]] const PrimitiveArrays& primitiveArrays() const {return primitives;}
+  //Bounds of every node over the shutter interval, or nothing when no object moves
+  [[nodiscard]] const std::vector<MovingAABB>& motionBounds() const {return motion;}
+  [[nodiscard]] std::size_t memoryBytes() const{
+	return nodes.size() * sizeof(BVHNode) + motion.size() * sizeof(MovingAABB) + primitives.memoryBytes();
+  }
+
+  //Expected cost of tracing a random ray through the tree, using the cost model from SAHSettings
+  [[nodiscard]] Real sahCost() const{
+	Real cost = 0.0;
+	for(const auto& node : nodes){
+	  Real area = node.box().surfaceArea();
+	  if(node.type() == BVHNodeType::Leaf){
+		cost += SAHSettings::intersectionCost * Real(node.rightChild()) * area;
+	  }else{
+		cost += SAHSettings::traversalCost * area;
+	  }
+	}
+	Real rootArea = nodes[root].box().surfaceArea();
+	return rootArea > 0 ? cost / rootArea : Real(0.0);
+  }
+
+  //Recomputes every box for objects which moved since the build, keeping the topology. The objects must be the ones
+  //the hierarchy was built from, in the same order. Leaves are refitted in parallel, after which each of them walks
+  //up through the parents; the second child to arrive at a parent computes its box and continues, the first stops.
+  //Returns the SAH cost of the refitted tree, which grows as the topology stops matching the objects.
+  Real refit(const std::vector<BVHObject>& objects, Real offsetTime){
+	auto startTime = std::chrono::high_resolution_clock::now();
+	std::vector<std::atomic<std::uint8_t>> arrivals(nodes.size());
+	tbb::parallel_for(BVHIndex(0),BVHIndex(nodes.size()),[&](BVHIndex index){
+	  BVHNode& leaf = nodes[index];
+	  if(leaf.type() != BVHNodeType::Leaf || leaf.rightChild() == 0){
+		return;
+	  }
+	  AABB box = objects[order[leaf.leftChild()]].boundingBox(offsetTime);
+	  for (BVHIndex i = leaf.leftChild() + 1; i < leaf.leftChild() + leaf.rightChild(); ++i) {
+		box = AABB(box,objects[order[i]].boundingBox(offsetTime));
+	  }
+	  leaf.setBox(box);
+	  while(index != root){
+		index = nodes[index].parent();
+		if(arrivals[index].fetch_add(1,std::memory_order_acq_rel) == 0){
+		  return;
+		}
+		BVHNode& node = nodes[index];
+		node.setBox(AABB(nodes[node.leftChild()].box(),nodes[node.rightChild()].box()));
+	  }
+	});
+	primitives = PrimitiveArrays();
+	finishBuild(objects,offsetTime,startTime);
+	statistics.cached = false;
+	statistics.refitted = true;
+	return statistics.sahCost;
+  }
+
+  //Closest hit along the ray. Only its distance and primitive are tracked, see surfaceInteraction()
+  [[nodiscard]] std::optional<PrimitiveHit> intersect(const Ray& ray, Real tMin, Real tMax) const{
+	TraversalCounters unused;
+	return motion.empty() ? closestHit<false,false>(ray,tMin,tMax,unused) : closestHit<false,true>(ray,tMin,tMax,unused);
+  }
+  [[nodiscard]] std::optional<PrimitiveHit> intersect(const Ray& ray, Real tMin, Real tMax, TraversalCounters& counters) const{
+	return motion.empty() ? closestHit<true,false>(ray,tMin,tMax,counters) : closestHit<true,true>(ray,tMin,tMax,counters);
+  }
+  //Traces a packet of coherent rays together. A node is visited when any ray of the packet hits it,
+  //leaves only test the rays which hit them. The rays of a packet have their own times, so the packet is tested
+  //against the bounds over the whole shutter interval.
+  template<std::size_t Size>
+  [[nodiscard]] std::array<std::optional<PrimitiveHit>,Size> intersect(const RayPacket<Size>& packet, Real tMax) const{
+	using RealVec = typename RayPacket<Size>::RealVec;
+	std::array<std::optional<PrimitiveHit>,Size> hits;
+	RealVec laneTMax = RealVec{} + tMax;
+
+	//Every level pushes at most one entry more than it pops
+	std::array<BVHIndex,2*maxBVHDepth> stack;
+	std::size_t stackSize = 0;
+	stack[stackSize++] = root;
+	while(stackSize != 0){
+	  const BVHNode& node = nodes[stack[--stackSize]];
+	  auto active = packet.hit(node.box().minimum(),node.box().maximum(),laneTMax);
+	  if(!RayPacket<Size>::any(active)){
+		continue;
+	  }
+	  if(node.type() == BVHNodeType::Leaf){
+		for (std::size_t lane = 0; lane < Size; ++lane) {
+		  if(!active[lane]){
+			continue;
+		  }
+		  Real tMaxLane = laneTMax[lane];
+		  primitives.hit(packet.ray(lane),node.leftChild(),node.rightChild(),packet.minimumDistance(lane),tMaxLane,
+						 hits[lane]);
+		  laneTMax[lane] = tMaxLane;
+		}
+		continue;
+	  }
+	  //Push the child which lies further along the packet direction first
+	  Vec3r separation = nodes[node.rightChild()].box().centroid() - nodes[node.leftChild()].box().centroid();
+	  bool leftFirst = separation.dot(packet.direction()) >= 0;
+	  assert(stackSize + 2 <= stack.size());
+	  stack[stackSize++] = leftFirst ? node.rightChild() : node.leftChild();
+	  stack[stackSize++] = leftFirst ? node.leftChild() : node.rightChild();
+	}
+	return hits;
+  }
+  [[nodiscard]] HitRecord surfaceInteraction(const Ray& ray, const PrimitiveHit& hit) const{
+	return primitives.surfaceInteraction(ray,hit);
+  }
+  //The previous stackless kernel, which never narrows tMax. Kept to compare traversal statistics against.
+  [[nodiscard]] std::optional<PrimitiveHit> hitStackless(const Ray& ray, Real tMin, Real tMax,
+													  TraversalCounters& counters) const{
+	counters.rays++;
+	if(nodes[root].type() == BVHNodeType::Leaf){
+	  //The traversal below assumes the root has children, which is not the case for tiny scenes
+	  std::optional<PrimitiveHit> hit = std::nullopt;
+	  counters.boxTests++;
+	  if(nodes[root].box().hit(ray,tMin,tMax)){
+		counters.nodesVisited++;
+		counters.leavesVisited++;
+		counters.primitiveTests += nodes[root].rightChild();
+		Real leafTMax = tMax;
+		primitives.hit(ray,nodes[root].leftChild(),nodes[root].rightChild(),tMin,leafTMax,hit);
+	  }
+	  return hit;
+	}
 	BVHIndex index = nodes[root].leftChild();
 	enum class State{
 	  parent,
@@ -153,21 +652,22 @@ class BVH{
 	  child
 	};
 	State state = State::parent;
-	std::optional<HitRecord> hit = std::nullopt;
+	std::optional<PrimitiveHit> hit = std::nullopt;
 	for(;;){
 	  switch(state){
 		case State::parent:{
 		  const BVHNode& current = nodes[index];
+		  counters.boxTests++;
 		  if(current.box().hit(ray,tMin,tMax)){
+			counters.nodesVisited++;
 			if(current.type() == BVHNodeType::Leaf){
+			  counters.leavesVisited++;
+			  counters.primitiveTests += current.rightChild();
 			  //current.leftChild() or index?
-			  size_t objectIndex = current.leftChild();
-			  uint32_t numInList = current.rightChild();
-			  for (uint32_t i = 0; i < numInList ; ++i) {
-				hit = closestHitRecord(hit,objects[objectIndex].hit(ray,tMin,tMax));
-				//TODO: update ray search interval tMin tMax based on collision
-				objectIndex++;
-			  }
+			  Real leafTMax = tMax;
+			  std::optional<PrimitiveHit> leafHit = std::nullopt;
+			  primitives.hit(ray,current.leftChild(),current.rightChild(),tMin,leafTMax,leafHit);
+			  hit = closestHitRecord(hit,leafHit);
 
 
 			  index = nodes[current.parent()].rightChild();
@@ -186,16 +686,17 @@ class BVH{
 		//visit right nodes from left node
 		case State::sibling:{
 		  const BVHNode& current = nodes[index];
+		  counters.boxTests++;
 		  if(current.box().hit(ray,tMin,tMax)){
+			counters.nodesVisited++;
 			if(current.type() == BVHNodeType::Leaf){
+			  counters.leavesVisited++;
+			  counters.primitiveTests += current.rightChild();
 			  //current.leftChild() or index?
-			  size_t objectIndex = current.leftChild();
-			  uint32_t numInList = current.rightChild();
-			  for (uint32_t i = 0; i < numInList ; ++i) {
-				hit = closestHitRecord(hit,objects[objectIndex].hit(ray,tMin,tMax));
-				//TODO: update ray search interval tMin tMax based on collision
-				objectIndex++;
-			  }
+			  Real leafTMax = tMax;
+			  std::optional<PrimitiveHit> leafHit = std::nullopt;
+			  primitives.hit(ray,current.leftChild(),current.rightChild(),tMin,leafTMax,leafHit);
+			  hit = closestHitRecord(hit,leafHit);
 
 			  index = current.parent();
 			  state = State::child;
@@ -229,10 +730,135 @@ class BVH{
 	}
   }
  private:
+  //Stack based closest hit traversal. Visits the nearer child first and culls every node behind the closest hit.
+  //With Moving, boxes are tested at the time of the ray instead of over the whole shutter interval.
+  template<bool Counting, bool Moving>
+  [[nodiscard]] std::optional<PrimitiveHit> closestHit(const Ray& ray, Real tMin, Real tMax,
+													TraversalCounters& counters) const{
+	if constexpr(Counting){ counters.rays++; }
+	TraversalRay traversalRay(ray);
+	auto boxHit = [&](BVHIndex index, Real& tNear){
+	  if constexpr(Moving){
+		return motion[index].hit(traversalRay,ray.timeOffset,tMin,tMax,tNear);
+	  }else{
+		return nodes[index].box().hit(traversalRay,tMin,tMax,tNear);
+	  }
+	};
+	std::optional<PrimitiveHit> hit = std::nullopt;
+
+	struct StackEntry{
+	  BVHIndex index;
+	  Real tNear;
+	};
+	//Every level pushes at most one entry more than it pops
+	std::array<StackEntry,2*maxBVHDepth> stack;
+	std::size_t stackSize = 0;
+	{
+	  Real tNear;
+	  if constexpr(Counting){ counters.boxTests++; }
+	  if(!boxHit(root,tNear)){
+		return hit;
+	  }
+	  stack[stackSize++] = StackEntry{.index = root,.tNear = tNear};
+	}
+
+	while(stackSize != 0){
+	  const StackEntry entry = stack[--stackSize];
+	  if(entry.tNear > tMax){
+		continue;
+	  }
+	  const BVHNode& node = nodes[entry.index];
+	  if constexpr(Counting){ counters.nodesVisited++; }
+	  if(node.type() == BVHNodeType::Leaf){
+		if constexpr(Counting){
+		  counters.leavesVisited++;
+		  counters.primitiveTests += node.rightChild();
+		}
+		primitives.hit(ray,node.leftChild(),node.rightChild(),tMin,tMax,hit);
+		continue;
+	  }
+	  if constexpr(Counting){ counters.boxTests += 2; }
+	  Real leftNear;
+	  Real rightNear;
+	  bool hitLeft = boxHit(node.leftChild(),leftNear);
+	  bool hitRight = boxHit(node.rightChild(),rightNear);
+	  assert(stackSize + 2 <= stack.size());
+	  if(hitLeft && hitRight){
+		//Push the far child first so the near child is popped first
+		if(leftNear <= rightNear){
+		  stack[stackSize++] = StackEntry{.index = node.rightChild(),.tNear = rightNear};
+		  stack[stackSize++] = StackEntry{.index = node.leftChild(),.tNear = leftNear};
+		}else{
+		  stack[stackSize++] = StackEntry{.index = node.leftChild(),.tNear = leftNear};
+		  stack[stackSize++] = StackEntry{.index = node.rightChild(),.tNear = rightNear};
+		}
+	  }else if(hitLeft){
+		stack[stackSize++] = StackEntry{.index = node.leftChild(),.tNear = leftNear};
+	  }else if(hitRight){
+		stack[stackSize++] = StackEntry{.index = node.rightChild(),.tNear = rightNear};
+	  }
+	}
+	return hit;
+  }
+
+  void finishBuild(const std::vector<BVHObject>& objects, Real offsetTime,
+				   std::chrono::high_resolution_clock::time_point startTime){
+	for(std::uint32_t object : order){
+	  objects[object].addTo(primitives);
+	}
+	primitives.finalize();
+	computeMotion(objects,offsetTime);
+	auto endTime = std::chrono::high_resolution_clock::now();
+
+	statistics.buildSeconds = std::chrono::duration<double>(endTime-startTime).count();
+	statistics.sahCost = sahCost();
+	statistics.numNodes = nodes.size();
+	statistics.numLeaves = static_cast<std::size_t>(std::count_if(nodes.begin(),nodes.end(),[](const BVHNode& node){
+	  return node.type() == BVHNodeType::Leaf;
+	}));
+  }
+
+  //Bounds of every node at the opening and closing of the shutter, which both builders place after their children
+  void computeMotion(const std::vector<BVHObject>& objects, Real offsetTime){
+	motion.clear();
+	if(offsetTime <= 0 || objects.empty()){
+	  return;
+	}
+	std::vector<MovingAABB> bounds(nodes.size());
+	std::vector<AABB> close(nodes.size());
+	bool moving = false;
+	for (BVHIndex index = 0; index < nodes.size(); ++index) {
+	  const BVHNode& node = nodes[index];
+	  AABB open;
+	  if(node.type() == BVHNodeType::Leaf){
+		open = objects[order[node.leftChild()]].boundingBoxAt(0);
+		close[index] = objects[order[node.leftChild()]].boundingBoxAt(offsetTime);
+		for (BVHIndex i = node.leftChild() + 1; i < node.leftChild() + node.rightChild(); ++i) {
+		  open = AABB(open,objects[order[i]].boundingBoxAt(0));
+		  close[index] = AABB(close[index],objects[order[i]].boundingBoxAt(offsetTime));
+		}
+	  }else{
+		assert(node.leftChild() < index && node.rightChild() < index);
+		const MovingAABB& left = bounds[node.leftChild()];
+		const MovingAABB& right = bounds[node.rightChild()];
+		open = AABB(AABB(left.minimum(),left.maximum()),AABB(right.minimum(),right.maximum()));
+		close[index] = AABB(close[node.leftChild()],close[node.rightChild()]);
+	  }
+	  bounds[index] = MovingAABB(open,close[index],offsetTime);
+	  moving |= bounds[index].moving();
+	}
+	if(moving){
+	  motion = std::move(bounds);
+	}
+  }
+
   BVHIndex root;
-  std::vector<BVHObject> objects;
+  PrimitiveArrays primitives;
 
   std::vector<BVHNode> nodes;
+  std::vector<MovingAABB> motion; //Empty when no object moves
+  std::vector<std::uint32_t> order;
+  BVHBuildStatistics statistics;
 };
 
 #endif //RAYTRACING_SRC_BOUNDINGVOLUMEHIERARCHY_H_
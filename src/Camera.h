@@ -6,6 +6,7 @@
 #define RAYTRACING_SRC_CAMERA_H_
 #include "Vec3.h"
 #include "Ray.h"
+#include "Random.h"
 
 class Camera{
  public:
@@ -13,9 +14,9 @@ class Camera{
 		 Real aperature,
 		 Real focusDist,
 		 Real shutterCloseTime){
-	Real theta = verticalFOVdegrees*(M_PI/180.0);
-	Real h = tan(theta*0.5);
-	Real viewportHeight = 2.0*h;
+	Real theta = verticalFOVdegrees*Real(M_PI/180.0);
+	Real h = std::tan(theta*Real(0.5));
+	Real viewportHeight = Real(2.0)*h;
 	Real viewportWidth = aspectRatio*viewportHeight;
 
 	w = (lookFrom-lookAt).normalized();
@@ -0,0 +1,15 @@
+#ifndef RAYTRACING_SRC_COMMANDLINE_H_
+#define RAYTRACING_SRC_COMMANDLINE_H_
+
+#include <charconv>
+#include <string_view>
+#include <system_error>
+
+//Parses the whole of text as a number, so values such as "12px" or "" are rejected instead of partially read
+template<typename T>
+bool parseNumber(std::string_view text, T& value){
+  auto [end, error] = std::from_chars(text.data(),text.data()+text.size(),value);
+  return error == std::errc() && end == text.data()+text.size();
+}
+
+#endif //RAYTRACING_SRC_COMMANDLINE_H_
@@ -4,9 +4,73 @@
 
 #ifndef RAYTRACING_SRC_DEFINITIONS_H_
 #define RAYTRACING_SRC_DEFINITIONS_H_
+#include <cstddef>
+#include <cmath>
+#include <type_traits>
+#if defined(__SSE2__) || defined(__AVX__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
 
 template<class... Ts> struct overload : Ts... { using Ts::operator()...; };
 template<class... Ts> overload(Ts...) -> overload<Ts...>;
+//Precision of the render path. Scene setup is always done in double and converted when the scene is built.
+#ifdef RAYTRACING_SINGLE_PRECISION
+using Real = float;
+#else
 using Real = double;
+#endif
+
+//Counts the traversal and path work of every render thread and records the traversal cost of every pixel.
+//Without it the counting code is compiled out.
+#ifdef RAYTRACING_INSTRUMENTATION
+constexpr bool instrumentationEnabled = true;
+#else
+constexpr bool instrumentationEnabled = false;
+#endif
+
+//Width of the widest SIMD registers the target supports
+#if defined(__AVX512F__)
+constexpr std::size_t simdBytes = 64;
+#elif defined(__AVX__)
+constexpr std::size_t simdBytes = 32;
+#else
+constexpr std::size_t simdBytes = 16;
+#endif
+
+//Wraps the GCC/Clang vector extension, which compiles to SSE/AVX2/AVX-512 depending on -march
+template<typename T, std::size_t Width>
+struct SimdLanes{
+  typedef T Vec __attribute__((vector_size(Width*sizeof(T))));
+};
+
+//Square root of every lane of a SimdLanes vector. The vector extension has no square root and std::sqrt per lane is
+//not vectorized because it may set errno, so registers the target supports use the sqrt instruction directly.
+//Negative lanes give NaN.
+template<typename Vec>
+inline Vec sqrtLanes(const Vec& values){
+  using T = std::remove_cvref_t<decltype(values[0])>;
+  constexpr bool isDouble = std::is_same_v<T,double>;
+#if defined(__AVX512F__)
+  //The zero masked forms with every lane selected, as the unmasked ones trip -Wmaybe-uninitialized in GCC 12
+  if constexpr(sizeof(Vec) == 64){
+	if constexpr(isDouble){ return _mm512_maskz_sqrt_pd(0xFF,values); } else { return _mm512_maskz_sqrt_ps(0xFFFF,values); }
+  }
+#endif
+#if defined(__AVX__)
+  if constexpr(sizeof(Vec) == 32){
+	if constexpr(isDouble){ return _mm256_sqrt_pd(values); } else { return _mm256_sqrt_ps(values); }
+  }
+#endif
+#if defined(__SSE2__)
+  if constexpr(sizeof(Vec) == 16){
+	if constexpr(isDouble){ return _mm_sqrt_pd(values); } else { return _mm_sqrt_ps(values); }
+  }
+#endif
+  Vec result = values;
+  for (std::size_t lane = 0; lane < sizeof(Vec) / sizeof(T); ++lane) {
+	result[lane] = std::sqrt(values[lane]);
+  }
+  return result;
+}
 
 #endif //RAYTRACING_SRC_DEFINITIONS_H_
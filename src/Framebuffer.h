@@ -0,0 +1,63 @@
+#ifndef RAYTRACING_SRC_FRAMEBUFFER_H_
+#define RAYTRACING_SRC_FRAMEBUFFER_H_
+
+#include <cstddef>
+#include <new>
+#include <numeric>
+#include <span>
+#include <vector>
+
+template<typename T, std::size_t Alignment>
+struct AlignedAllocator{
+  using value_type = T;
+  template<typename U>
+  struct rebind{ using other = AlignedAllocator<U,Alignment>; };
+
+  AlignedAllocator() = default;
+  template<typename U>
+  explicit AlignedAllocator(const AlignedAllocator<U,Alignment>&){}
+
+  T* allocate(std::size_t n){
+	return static_cast<T*>(::operator new(n * sizeof(T),std::align_val_t(Alignment)));
+  }
+  void deallocate(T* pointer, std::size_t){
+	::operator delete(pointer,std::align_val_t(Alignment));
+  }
+  bool operator==(const AlignedAllocator&) const{ return true;}
+};
+
+//Image which the render jobs write into in place. The storage starts on a cache line and every row is padded to
+//whole cache lines, so a tile whose width covers whole cache lines never shares a line with its neighbours.
+template<typename T>
+class Framebuffer{
+ public:
+  static constexpr std::size_t cacheLineBytes = 64;
+
+  Framebuffer(int width, int height) : imageWidth{width}, imageHeight{height},
+  rowStride{paddedWidth(width)}, pixels(rowStride * std::size_t(height), T{}){}
+
+  T& operator()(int i, int j){ return pixels[index(i,j)];}
+  const T& operator()(int i, int j) const{ return pixels[index(i,j)];}
+  //Position of pixel (i,j) in data()
+  [[nodiscard]] std::size_t index(int i, int j) const{ return std::size_t(j) * rowStride + std::size_t(i);}
+  [[nodiscard]] std::span<T> row(int j){ return std::span<T>(pixels).subspan(index(0,j),std::size_t(imageWidth));}
+  [[nodiscard]] std::span<const T> row(int j) const{
+	return std::span<const T>(pixels).subspan(index(0,j),std::size_t(imageWidth));
+  }
+  //All pixels including the row padding
+  [[nodiscard]] std::span<T> data(){ return pixels;}
+
+  [[nodiscard]] int width() const{ return imageWidth;}
+  [[nodiscard]] int height() const{ return imageHeight;}
+ private:
+  static std::size_t paddedWidth(int width){
+	std::size_t pixelsPerLine = cacheLineBytes / std::gcd(cacheLineBytes,sizeof(T));
+	return (std::size_t(width) + pixelsPerLine - 1) / pixelsPerLine * pixelsPerLine;
+  }
+  int imageWidth;
+  int imageHeight;
+  std::size_t rowStride;
+  std::vector<T,AlignedAllocator<T,cacheLineBytes>> pixels;
+};
+
+#endif //RAYTRACING_SRC_FRAMEBUFFER_H_
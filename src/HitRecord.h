@@ -7,6 +7,7 @@
 
 #include "Vec3.h"
 #include "Material.h"
+#include <cstdint>
 #include <optional>
 struct HitRecord{
   Vec3r point;
@@ -14,9 +15,18 @@ struct HitRecord{
   Real t;
   Material material;
   bool frontFace;
+  bool lightSampled = true; //Whether the light list can sample this point, instanced primitives are not in it
 };
 
-std::optional<HitRecord> closestHitRecord(std::optional<HitRecord> first, std::optional<HitRecord> second){
+//What traversal keeps of a hit. The full HitRecord is only computed for the closest hit, after traversal.
+struct PrimitiveHit{
+  Real t;
+  std::uint32_t primitive; //Index of the object in the order of the BVH leaves
+  std::uint32_t instancePrimitive = 0; //Primitive of the instanced geometry, if the object is an Instance
+};
+
+template<typename Hit>
+std::optional<Hit> closestHitRecord(std::optional<Hit> first, std::optional<Hit> second){
   if(first.has_value() && second.has_value()){
 	if(first->t < second->t){
 	  return first;
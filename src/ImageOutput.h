@@ -0,0 +1,239 @@
+#ifndef RAYTRACING_SRC_IMAGEOUTPUT_H_
+#define RAYTRACING_SRC_IMAGEOUTPUT_H_
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include "Framebuffer.h"
+#include "Vec3.h"
+
+enum class ImageFormat{
+  PPM, //Binary 8 bit RGB (P6), gamma 2
+  PFM, //Linear 32 bit floating point RGB, for HDR compositing
+  PNG  //8 bit RGB, gamma 2. Stored without compression, so no zlib is needed
+};
+
+//Averages the samples of every pixel, applies gamma 2 and quantizes to 8 bits, in parallel over the rows.
+//Rows are written top to bottom, 3 bytes per pixel, each row starting rowStride bytes after the previous one.
+inline void tonemap(const Framebuffer<Vec3r>& colors, const Framebuffer<int>& sampleCounts, std::span<std::uint8_t> out,
+			 std::size_t rowStride){
+  int height = colors.height();
+  tbb::parallel_for(tbb::blocked_range<int>(0,height),[&](const tbb::blocked_range<int>& rows){
+	for (int j = rows.begin(); j < rows.end(); ++j) {
+	  std::span<const Vec3r> colorRow = colors.row(j);
+	  std::span<const int> countRow = sampleCounts.row(j);
+	  std::uint8_t* pixel = out.data() + std::size_t(height-1-j) * rowStride;
+	  for (std::size_t i = 0; i < colorRow.size(); ++i) {
+		Real scale = Real(1.0) / Real(countRow[i]);
+		for (int c = 0; c < 3; ++c) {
+		  Real value = std::sqrt(std::clamp(scale * colorRow[i][c],Real(0),Real(1)));
+		  *pixel++ = static_cast<std::uint8_t>(Real(255.999) * value);
+		}
+	  }
+	}
+  });
+}
+
+inline std::vector<char> encodePPM(const Framebuffer<Vec3r>& colors, const Framebuffer<int>& sampleCounts){
+  std::string header = "P6\n" + std::to_string(colors.width()) + ' ' + std::to_string(colors.height()) + "\n255\n";
+  std::size_t rowBytes = 3 * std::size_t(colors.width());
+  std::vector<char> file(header.size() + rowBytes * std::size_t(colors.height()));
+  std::copy(header.begin(),header.end(),file.begin());
+  auto pixels = std::as_writable_bytes(std::span(file)).subspan(header.size());
+  tonemap(colors,sampleCounts,std::span(reinterpret_cast<std::uint8_t*>(pixels.data()),pixels.size()),rowBytes);
+  return file;
+}
+
+//PFM stores the bottom row first, which is the row order of the framebuffer, and the sign of the scale gives the byte order
+inline std::vector<char> encodePFM(const Framebuffer<Vec3r>& colors, const Framebuffer<int>& sampleCounts){
+  std::string header = "PF\n" + std::to_string(colors.width()) + ' ' + std::to_string(colors.height()) +
+	  (std::endian::native == std::endian::little ? "\n-1.0\n" : "\n1.0\n");
+  std::size_t rowBytes = 3 * sizeof(float) * std::size_t(colors.width());
+  std::vector<char> file(header.size() + rowBytes * std::size_t(colors.height()));
+  std::copy(header.begin(),header.end(),file.begin());
+  tbb::parallel_for(tbb::blocked_range<int>(0,colors.height()),[&](const tbb::blocked_range<int>& rows){
+	for (int j = rows.begin(); j < rows.end(); ++j) {
+	  std::span<const Vec3r> colorRow = colors.row(j);
+	  std::span<const int> countRow = sampleCounts.row(j);
+	  std::vector<float> linear(3 * colorRow.size());
+	  for (std::size_t i = 0; i < colorRow.size(); ++i) {
+		Real scale = Real(1.0) / Real(countRow[i]);
+		for (int c = 0; c < 3; ++c) {
+		  linear[3*i+std::size_t(c)] = static_cast<float>(scale * colorRow[i][c]);
+		}
+	  }
+	  std::memcpy(file.data() + header.size() + std::size_t(j) * rowBytes,linear.data(),rowBytes);
+	}
+  });
+  return file;
+}
+
+inline std::uint32_t crc32(std::span<const char> bytes, std::uint32_t crc = 0){
+  static const std::array<std::uint32_t,256> table = [](){
+	std::array<std::uint32_t,256> entries{};
+	for (std::uint32_t n = 0; n < 256; ++n) {
+	  std::uint32_t c = n;
+	  for (int k = 0; k < 8; ++k) {
+		c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+	  }
+	  entries[n] = c;
+	}
+	return entries;
+  }();
+  crc = ~crc;
+  for(char byte : bytes){
+	crc = table[(crc ^ static_cast<std::uint8_t>(byte)) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+//A zlib stream of uncompressed deflate blocks, each at most 65535 bytes, followed by the Adler-32 checksum
+inline std::vector<char> zlibStore(std::span<const char> data){
+  constexpr std::size_t maxBlock = 65535;
+  std::vector<char> stream;
+  stream.reserve(data.size() + 5 * (data.size() / maxBlock + 1) + 6);
+  stream.push_back(0x78);
+  stream.push_back(0x01);
+  std::size_t offset = 0;
+  do{
+	std::size_t length = std::min(maxBlock,data.size() - offset);
+	bool last = offset + length == data.size();
+	stream.push_back(last ? 1 : 0);
+	stream.push_back(static_cast<char>(length & 0xFF));
+	stream.push_back(static_cast<char>(length >> 8));
+	stream.push_back(static_cast<char>(~length & 0xFF));
+	stream.push_back(static_cast<char>((~length >> 8) & 0xFF));
+	stream.insert(stream.end(),data.begin() + static_cast<std::ptrdiff_t>(offset),
+				  data.begin() + static_cast<std::ptrdiff_t>(offset + length));
+	offset += length;
+  } while(offset < data.size());
+
+  std::uint32_t a = 1;
+  std::uint32_t b = 0;
+  for(char byte : data){
+	a = (a + static_cast<std::uint8_t>(byte)) % 65521;
+	b = (b + a) % 65521;
+  }
+  std::uint32_t adler = (b << 16) | a;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+	stream.push_back(static_cast<char>((adler >> shift) & 0xFF));
+  }
+  return stream;
+}
+
+inline std::vector<char> encodePNG(const Framebuffer<Vec3r>& colors, const Framebuffer<int>& sampleCounts){
+  //Every scanline starts with its filter type, 0 means the bytes are stored as they are
+  std::size_t rowBytes = 1 + 3 * std::size_t(colors.width());
+  std::vector<char> scanlines(rowBytes * std::size_t(colors.height()),0);
+  auto pixels = std::as_writable_bytes(std::span(scanlines)).subspan(1);
+  tonemap(colors,sampleCounts,std::span(reinterpret_cast<std::uint8_t*>(pixels.data()),pixels.size()),rowBytes);
+
+  std::vector<char> file = {'\x89','P','N','G','\r','\n','\x1A','\n'};
+  auto appendChunk = [&file](const char* type, std::span<const char> data){
+	auto length = static_cast<std::uint32_t>(data.size());
+	for (int shift = 24; shift >= 0; shift -= 8) {
+	  file.push_back(static_cast<char>((length >> shift) & 0xFF));
+	}
+	std::size_t typeStart = file.size();
+	file.insert(file.end(),type,type+4);
+	file.insert(file.end(),data.begin(),data.end());
+	std::uint32_t crc = crc32(std::span(file).subspan(typeStart));
+	for (int shift = 24; shift >= 0; shift -= 8) {
+	  file.push_back(static_cast<char>((crc >> shift) & 0xFF));
+	}
+  };
+  std::array<char,13> header{};
+  for (int shift = 24, k = 0; shift >= 0; shift -= 8, ++k) {
+	header[std::size_t(k)] = static_cast<char>((static_cast<std::uint32_t>(colors.width()) >> shift) & 0xFF);
+	header[std::size_t(k+4)] = static_cast<char>((static_cast<std::uint32_t>(colors.height()) >> shift) & 0xFF);
+  }
+  header[8] = 8; //Bit depth
+  header[9] = 2; //Colour type RGB
+  std::vector<char> compressed = zlibStore(scanlines);
+  file.reserve(file.size() + compressed.size() + 64);
+  appendChunk("IHDR",header);
+  appendChunk("IDAT",compressed);
+  appendChunk("IEND",{});
+  return file;
+}
+
+inline std::vector<char> encodeImage(ImageFormat format, const Framebuffer<Vec3r>& colors, const Framebuffer<int>& sampleCounts){
+  switch(format){
+	case ImageFormat::PPM: return encodePPM(colors,sampleCounts);
+	case ImageFormat::PFM: return encodePFM(colors,sampleCounts);
+	case ImageFormat::PNG: return encodePNG(colors,sampleCounts);
+  }
+  return {};
+}
+
+//Black through blue and red to yellow as value goes from 0 to 1
+inline std::array<std::uint8_t,3> heatColor(float value){
+  float t = 3.0f * std::clamp(value,0.0f,1.0f);
+  float red = std::clamp(t - 1.0f,0.0f,1.0f);
+  float green = std::clamp(t - 2.0f,0.0f,1.0f);
+  float blue = t < 1.0f ? t : std::clamp(2.0f - t,0.0f,1.0f);
+  return {static_cast<std::uint8_t>(255.999f * red),static_cast<std::uint8_t>(255.999f * green),
+		  static_cast<std::uint8_t>(255.999f * blue)};
+}
+
+//Writes a per pixel cost as a binary PPM heat map. Costs are scaled to the 99th percentile, so that a handful of
+//extreme pixels do not wash out the rest of the image. Returns the cost which maps to full brightness, or nothing if
+//the file could not be written.
+inline std::optional<float> writeHeatmap(const char* fileName, const Framebuffer<float>& cost){
+  std::vector<float> sorted;
+  sorted.reserve(std::size_t(cost.width()) * std::size_t(cost.height()));
+  for (int j = 0; j < cost.height(); ++j) {
+	std::span<const float> row = cost.row(j);
+	sorted.insert(sorted.end(),row.begin(),row.end());
+  }
+  auto percentile = sorted.begin() + static_cast<std::ptrdiff_t>(sorted.size() * 99 / 100);
+  std::nth_element(sorted.begin(),percentile,sorted.end());
+  float scale = std::max(*percentile,1.0f);
+
+  std::string header = "P6\n" + std::to_string(cost.width()) + ' ' + std::to_string(cost.height()) + "\n255\n";
+  std::vector<char> file(header.begin(),header.end());
+  file.reserve(header.size() + 3 * sorted.size());
+  for (int j = cost.height()-1; j >= 0; --j) {
+	for(float value : cost.row(j)){
+	  std::array<std::uint8_t,3> color = heatColor(value / scale);
+	  file.insert(file.end(),color.begin(),color.end());
+	}
+  }
+  std::ofstream stream(fileName,std::ios::binary);
+  if(!stream.write(file.data(),static_cast<std::streamsize>(file.size()))){
+	return std::nullopt;
+  }
+  return scale;
+}
+
+//Encodes the whole image in memory and hands it to the stream in one write. Returns whether the write succeeded.
+inline bool writeImage(std::ostream& stream, ImageFormat format, const Framebuffer<Vec3r>& colors,
+				const Framebuffer<int>& sampleCounts){
+  std::vector<char> file = encodeImage(format,colors,sampleCounts);
+  stream.write(file.data(),static_cast<std::streamsize>(file.size()));
+  stream.flush();
+  return stream.good();
+}
+
+//Writes to stdout when fileName is null
+inline bool writeImage(const char* fileName, ImageFormat format, const Framebuffer<Vec3r>& colors,
+				const Framebuffer<int>& sampleCounts){
+  if(fileName == nullptr){
+	return writeImage(std::cout,format,colors,sampleCounts);
+  }
+  std::ofstream file(fileName,std::ios::binary);
+  return writeImage(file,format,colors,sampleCounts);
+}
+
+#endif //RAYTRACING_SRC_IMAGEOUTPUT_H_
@@ -0,0 +1,50 @@
+#ifndef RAYTRACING_SRC_INSTANCE_H_
+#define RAYTRACING_SRC_INSTANCE_H_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include "AABB.h"
+#include "HitRecord.h"
+#include "Ray.h"
+#include "Transform.h"
+
+class InstanceGeometry;
+
+//Shared geometry placed in a scene by a transform. Rays are moved into object space instead of the geometry being
+//moved into world space. The object space direction is not normalized, so distances along a ray are the same in
+//both spaces. The members which need the geometry itself are defined in InstanceGeometry.h.
+class Instance{
+ public:
+  //material replaces the materials of the geometry, if it is given
+  Instance(std::shared_ptr<const InstanceGeometry> instanced, const Transform& objectToWorld,
+		   std::optional<Material> material = std::nullopt);
+
+  [[nodiscard]] AABB boundingBox() const{ return bounds;}
+  [[nodiscard]] const InstanceGeometry& instancedGeometry() const{ return *geometry;}
+  [[nodiscard]] std::optional<HitRecord> hit(const Ray& ray, Real tMin, Real tMax) const;
+  //Closest hit on the geometry, in terms of the primitives of the geometry
+  [[nodiscard]] std::optional<PrimitiveHit> intersect(const Ray& ray, Real tMin, Real tMax) const;
+  //World space surface interaction of a hit found by intersect()
+  [[nodiscard]] HitRecord surfaceInteraction(const Ray& ray, const PrimitiveHit& hit) const;
+
+  template<typename Hash>
+  void hashContent(Hash& hash) const{
+	hash.add(geometryKey());
+	worldToObject.hashContent(hash);
+	hash.add(std::uint64_t(material.has_value() ? material->index() + 1 : 0));
+  }
+ private:
+  [[nodiscard]] Ray objectRay(const Ray& ray) const{
+	return Ray{.origin = worldToObject.point(ray.origin),.direction = worldToObject.vector(ray.direction),
+			   .timeOffset = ray.timeOffset};
+  }
+  [[nodiscard]] std::uint64_t geometryKey() const;
+
+  std::shared_ptr<const InstanceGeometry> geometry;
+  Transform worldToObject;
+  AABB bounds; //World space
+  std::optional<Material> material;
+};
+
+#endif //RAYTRACING_SRC_INSTANCE_H_
@@ -0,0 +1,97 @@
+#ifndef RAYTRACING_SRC_INSTANCEGEOMETRY_H_
+#define RAYTRACING_SRC_INSTANCEGEOMETRY_H_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+#include "Accelerator.h"
+#include "Instance.h"
+
+//Geometry with its own hierarchy, which is shared by every Instance of it. The scene hierarchy only holds the
+//instances, so a copy costs a transform and a leaf entry instead of its primitives and nodes.
+//Primitives are added in object space, after which build() must be called before the geometry is instanced.
+class InstanceGeometry{
+ public:
+  void addSphere(SphereData sphere){
+	objects.emplace_back(sphere);
+  }
+  void addRectangle(AARectangleData rectangle){
+	objects.emplace_back(rectangle);
+  }
+  void addMesh(TriangleMesh mesh){
+	meshes.push_back(std::make_shared<const TriangleMesh>(std::move(mesh)));
+	for (std::uint32_t face = 0; face < meshes.back()->faces.size(); ++face) {
+	  objects.emplace_back(MeshTriangle(*meshes.back(),face));
+	}
+  }
+  //Builds the hierarchy and releases the primitives, which the hierarchy keeps its own copy of. The meshes are kept,
+  //as the hierarchy refers to their vertices. Throws std::invalid_argument if no primitives were added, as an instance
+  //of nothing has no bounds.
+  void build(Real shutterTime, RandomDevice& device, const BVHSettings& settings = BVHSettings()){
+	if(objects.empty()){
+	  throw std::invalid_argument("InstanceGeometry::build needs at least one primitive");
+	}
+	bounds = objects.front().boundingBox(shutterTime);
+	for(const BVHObject& object : objects){
+	  bounds = AABB(bounds,object.boundingBox(shutterTime));
+	}
+	contentKey = bvhCacheKey(objects,shutterTime,settings.buildMethod);
+	accelerator = buildAccelerator(objects,shutterTime,device,settings);
+	objects = std::vector<BVHObject>();
+  }
+
+  [[nodiscard]] std::optional<PrimitiveHit> intersect(const Ray& ray, Real tMin, Real tMax) const{
+	return std::visit([&](const auto& bvh){ return bvh.intersect(ray,tMin,tMax);},accelerator);
+  }
+  [[nodiscard]] HitRecord surfaceInteraction(const Ray& ray, const PrimitiveHit& hit) const{
+	return std::visit([&](const auto& bvh){ return bvh.surfaceInteraction(ray,hit);},accelerator);
+  }
+  //Object space bounds over the whole shutter interval
+  [[nodiscard]] const AABB& boundingBox() const{ return bounds;}
+  //Hash of the primitives, which identifies the geometry in the key of a scene hierarchy cache
+  [[nodiscard]] std::uint64_t key() const{ return contentKey;}
+  [[nodiscard]] std::size_t memoryBytes() const{
+	return std::visit([](const auto& bvh){ return bvh.memoryBytes();},accelerator);
+  }
+ private:
+  std::vector<BVHObject> objects;
+  std::vector<std::shared_ptr<const TriangleMesh>> meshes;
+  Accelerator accelerator;
+  AABB bounds;
+  std::uint64_t contentKey = 0;
+};
+
+inline Instance::Instance(std::shared_ptr<const InstanceGeometry> instanced, const Transform& objectToWorld,
+				   std::optional<Material> material) :
+	geometry{std::move(instanced)}, worldToObject{objectToWorld.inverse()},
+	bounds{objectToWorld.box(geometry->boundingBox())}, material{material}{}
+
+inline std::optional<HitRecord> Instance::hit(const Ray& ray, Real tMin, Real tMax) const{
+  std::optional<PrimitiveHit> primitiveHit = intersect(ray,tMin,tMax);
+  if(!primitiveHit.has_value()){
+	return std::nullopt;
+  }
+  return surfaceInteraction(ray,primitiveHit.value());
+}
+inline std::optional<PrimitiveHit> Instance::intersect(const Ray& ray, Real tMin, Real tMax) const{
+  return geometry->intersect(objectRay(ray),tMin,tMax);
+}
+inline HitRecord Instance::surfaceInteraction(const Ray& ray, const PrimitiveHit& hit) const{
+  HitRecord record = geometry->surfaceInteraction(objectRay(ray),hit);
+  //Both spaces agree on the side of the surface the ray is on, so only the point and normal move
+  record.point = ray.at(hit.t);
+  record.normal = worldToObject.transposedVector(record.normal).normalized();
+  if(material.has_value()){
+	record.material = material.value();
+  }
+  //Emission found here cannot also have been light sampled, so it keeps full weight
+  record.lightSampled = false;
+  return record;
+}
+inline std::uint64_t Instance::geometryKey() const{
+  return geometry->key();
+}
+
+#endif //RAYTRACING_SRC_INSTANCEGEOMETRY_H_
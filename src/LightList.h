@@ -0,0 +1,105 @@
+#ifndef RAYTRACING_SRC_LIGHTLIST_H_
+#define RAYTRACING_SRC_LIGHTLIST_H_
+
+#include <algorithm>
+#include <optional>
+#include <variant>
+#include <vector>
+#include "Sphere.h"
+#include "Rectangle.h"
+#include "Triangle.h"
+#include "Random.h"
+
+//Point sampled on a light, as seen from the point it was sampled for
+struct LightSample{
+  Vec3r point;
+  Vec3r radiance;
+  Real pdf; //Solid angle density of the direction towards point
+};
+
+//Weight of a sample from the strategy with density pdf, when the strategy with density otherPdf could also have produced it
+inline Real powerHeuristic(Real pdf, Real otherPdf){
+  return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+}
+
+//All emissive primitives of a scene. A light is chosen proportional to its power and a point is then
+//chosen uniformly over its area, so the area density of any point on any light is emission / total power.
+class LightList{
+ public:
+  void push_back(const AARectangleData& rectangle, const Vec3r& emission){
+	lights.push_back(Light{.primitive = rectangle,.emission = emission});
+	addPower(rectangle.area(),emission);
+  }
+  void push_back(const SphereData& sphere, const Vec3r& emission){
+	lights.push_back(Light{.primitive = sphere,.emission = emission});
+	addPower(sphere.area(),emission);
+  }
+  void push_back(const TriangleData& triangle, const Vec3r& emission){
+	lights.push_back(Light{.primitive = triangle,.emission = emission});
+	addPower(triangle.area(),emission);
+  }
+  //Emissive faces of a mesh are sampled as separate triangles
+  void push_back(const MeshTriangle& triangle, const Vec3r& emission){
+	push_back(triangle.triangle(),emission);
+  }
+  [[nodiscard]] bool empty() const{ return lights.empty();}
+
+  [[nodiscard]] std::optional<LightSample> sample(const Vec3r& from, Real timeOffset, RandomDevice& device) const{
+	if(lights.empty()){
+	  return std::nullopt;
+	}
+	Real power = device.randomReal() * totalPower;
+	auto it = std::upper_bound(cumulativePower.begin(),cumulativePower.end(),power);
+	const Light& light = lights[std::min(std::size_t(it - cumulativePower.begin()),lights.size()-1)];
+
+	Vec3r point;
+	Vec3r normal;
+	if(const auto* rectangle = std::get_if<AARectangleData>(&light.primitive)){
+	  point = rectangle->point(device.randomReal(),device.randomReal());
+	  normal = rectangle->normal();
+	}else if(const auto* triangle = std::get_if<TriangleData>(&light.primitive)){
+	  point = triangle->point(device.randomReal(),device.randomReal());
+	  normal = triangle->normal();
+	}else{
+	  normal = device.randomInUnitSphere().normalized();
+	  point = std::get<SphereData>(light.primitive).surfacePoint(normal,timeOffset);
+	}
+	Real density = pdf(point-from,normal,light.emission);
+	if(density <= 0){
+	  return std::nullopt;
+	}
+	return LightSample{.point = point,.radiance = light.emission,.pdf = density};
+  }
+  //Solid angle density with which sample() produces the direction along ray to the given point on a light,
+  //which is 0 for emissive points that are not in the list
+  [[nodiscard]] Real pdf(const Ray& ray, const HitRecord& hit, const Vec3r& emission) const{
+	if(!hit.lightSampled){
+	  return 0;
+	}
+	return pdf(hit.point-ray.origin,hit.normal,emission);
+  }
+ private:
+  struct Light{
+	std::variant<AARectangleData,SphereData,TriangleData> primitive;
+	Vec3r emission;
+  };
+  void addPower(Real area, const Vec3r& emission){
+	totalPower += area * (emission.x() + emission.y() + emission.z());
+	cumulativePower.push_back(totalPower);
+  }
+  [[nodiscard]] Real pdf(const Vec3r& toLight, const Vec3r& lightNormal, const Vec3r& emission) const{
+	Real squaredDistance = toLight.squaredNorm();
+	Real cosine = std::abs(lightNormal.dot(toLight)) / std::sqrt(squaredDistance);
+	if(cosine <= 0 || totalPower <= 0){
+	  return 0;
+	}
+	Real areaDensity = (emission.x() + emission.y() + emission.z()) / totalPower;
+	return areaDensity * squaredDistance / cosine;
+  }
+
+  std::vector<Light> lights;
+  std::vector<Real> cumulativePower;
+  Real totalPower = 0;
+};
+
+#endif //RAYTRACING_SRC_LIGHTLIST_H_
@@ -0,0 +1,50 @@
+#ifndef RAYTRACING_SRC_MAPPEDFILE_H_
+#define RAYTRACING_SRC_MAPPEDFILE_H_
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//Read only memory map of a whole file. Pages are loaded by the kernel when they are first touched,
+//so opening a file costs nothing and only the parts which are used are ever read.
+class MappedFile{
+ public:
+  //Returns null when the file cannot be opened or mapped
+  static std::shared_ptr<const MappedFile> open(const std::string& path){
+	int descriptor = ::open(path.c_str(),O_RDONLY);
+	if(descriptor < 0){
+	  return nullptr;
+	}
+	struct stat status{};
+	if(::fstat(descriptor,&status) != 0 || status.st_size <= 0){
+	  ::close(descriptor);
+	  return nullptr;
+	}
+	auto size = static_cast<std::size_t>(status.st_size);
+	void* address = ::mmap(nullptr,size,PROT_READ,MAP_PRIVATE,descriptor,0);
+	::close(descriptor); //The mapping keeps its own reference to the file
+	if(address == MAP_FAILED){
+	  return nullptr;
+	}
+	return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const std::byte*>(address),size));
+  }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile(){
+	::munmap(const_cast<std::byte*>(data),size);
+  }
+
+  //Starts on a page boundary
+  [[nodiscard]] std::span<const std::byte> bytes() const{ return {data,size};}
+ private:
+  MappedFile(const std::byte* data, std::size_t size) : data{data}, size{size}{}
+  const std::byte* data;
+  std::size_t size;
+};
+
+#endif //RAYTRACING_SRC_MAPPEDFILE_H_
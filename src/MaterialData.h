@@ -13,15 +13,16 @@
 #include <variant>
 
 
-Real reflectance(Real cosine, Real refractionIndex){
+inline Real reflectance(Real cosine, Real refractionIndex){
   Real r0 = (1-refractionIndex) / (1+refractionIndex);
   r0 = r0*r0;
-  return r0 + (1-r0)*pow(1-cosine,5);
+  return r0 + (1-r0)*std::pow(1-cosine,Real(5));
 }
 
 struct DiffuseMaterial{
-  explicit DiffuseMaterial(Vec3r color) : color{color},emittedColor{Vec3r(0,0,0)}{};
-  explicit DiffuseMaterial(Vec3r color,Vec3r emittedColor) : color{color},emittedColor{emittedColor}{};
+  //Scene descriptions are written in double precision and rounded to Real once here
+  explicit DiffuseMaterial(const Vec3d& color) : color{color},emittedColor{Vec3r(0,0,0)}{};
+  explicit DiffuseMaterial(const Vec3d& color,const Vec3d& emittedColor) : color{color},emittedColor{emittedColor}{};
 
   Vec3r color;
   Vec3r emittedColor;
@@ -42,7 +43,7 @@ struct DiffuseMaterial{
 };
 
 struct MetalMaterial{
-  MetalMaterial(Vec3r color, Real metalFuzziness) : color{color}, metalFuzziness{metalFuzziness}{};
+  MetalMaterial(const Vec3d& color, double metalFuzziness) : color{color}, metalFuzziness{static_cast<Real>(metalFuzziness)}{};
   Vec3r color;
   Real metalFuzziness;
   bool scatter(const Ray &in, const HitRecord &record, Ray &out, Vec3r &outColor, RandomDevice& device) const {
@@ -57,16 +58,16 @@ struct MetalMaterial{
   }
 };
 struct DielectricMaterial{
-  explicit DielectricMaterial(Real refractionIndex) : refractionIndex{refractionIndex}{};
+  explicit DielectricMaterial(double refractionIndex) : refractionIndex{static_cast<Real>(refractionIndex)}{};
 
   Real refractionIndex;
 
   bool scatter(const Ray &in, const HitRecord &record, Ray &out, Vec3r &outColor, RandomDevice& device) const {
 	outColor = Vec3r(1.0, 1.0, 1.0);
-	Real refractionRatio = record.frontFace ? (1.0 / refractionIndex) : refractionIndex;
+	Real refractionRatio = record.frontFace ? (Real(1.0) / refractionIndex) : refractionIndex;
 	Vec3r unitDir = in.direction.normalized();
-	Real cosTheta = fmin(-(unitDir).dot(record.normal), 1.0);
-	Real sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+	Real cosTheta = std::min(-(unitDir).dot(record.normal), Real(1.0));
+	Real sinTheta = std::sqrt(Real(1.0) - cosTheta * cosTheta);
 	bool cannotRefract = refractionRatio * sinTheta > Real(1.0) || (reflectance(cosTheta, refractionRatio) > device.randomReal());
 
 	Vec3r direction = cannotRefract ? reflect(unitDir, record.normal) : refract(unitDir, record.normal, refractionRatio);
@@ -79,11 +80,28 @@ struct DielectricMaterial{
   }
 };
 
+//Matches the order of the alternatives in MaterialData
+enum class MaterialType : int{
+  Diffuse,
+  Metal,
+  Dielectric
+};
+constexpr std::size_t numMaterialTypes = 3;
+
 struct MaterialData {
  public:
   template<typename U>
   MaterialData(U data) : material(data){};
 
+  [[nodiscard]] MaterialType type() const{
+	return static_cast<MaterialType>(material.index());
+  }
+  //Access for code which has already dispatched on type()
+  template<typename T>
+  [[nodiscard]] const T& get() const{
+	return *std::get_if<T>(&material);
+  }
+
   bool scatter(const Ray &in, const HitRecord &record, Ray &out, Vec3r &outColor, RandomDevice& device) const {
 	return std::visit(
 		overload{
@@ -102,6 +120,15 @@ struct MaterialData {
 			[&](const DielectricMaterial &)	{ return DielectricMaterial::emitted(); }
 		}, material);
   }
+  //Emission does not depend on the hit, so lights can be collected before rendering
+  [[nodiscard]] Vec3r emission() const{
+	return std::visit(
+		overload{
+			[&](const DiffuseMaterial &mat) 		{ return mat.emittedColor; },
+			[&](const MetalMaterial &) 		{ return MetalMaterial::emitted(); },
+			[&](const DielectricMaterial &)	{ return DielectricMaterial::emitted(); }
+		}, material);
+  }
  private:
   std::variant<DiffuseMaterial, MetalMaterial, DielectricMaterial> material;
 
@@ -0,0 +1,124 @@
+#ifndef RAYTRACING_SRC_OBJFILE_H_
+#define RAYTRACING_SRC_OBJFILE_H_
+
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Triangle.h"
+
+//Streaming Wavefront OBJ reader. The file is mapped and parsed in place, vertex positions and faces go straight
+//into the buffers of the mesh, so no line or face is ever copied into a temporary object. Only 'v' and 'f'
+//statements are used. Faces with more than three vertices are split into a fan of triangles, texture coordinates
+//and normals in 'v/vt/vn' references are skipped and negative indices count back from the last vertex.
+class ObjReader{
+ public:
+  //Returns nothing and sets error, including the line number, when the file cannot be read or is malformed
+  static std::optional<TriangleMesh> read(const std::string& path, Material material, std::string& error){
+	std::shared_ptr<const MappedFile> file = MappedFile::open(path);
+	if(!file){
+	  error = "cannot open " + path;
+	  return std::nullopt;
+	}
+	std::span<const std::byte> bytes = file->bytes();
+	ObjReader reader(std::string_view(reinterpret_cast<const char*>(bytes.data()),bytes.size()));
+	reader.mesh.material = material;
+	if(!reader.parse()){
+	  error = path + ":" + std::to_string(reader.lineNumber) + ": " + reader.message;
+	  return std::nullopt;
+	}
+	return std::move(reader.mesh);
+  }
+ private:
+  explicit ObjReader(std::string_view text) : text{text}{}
+
+  bool parse(){
+	std::vector<std::uint32_t> polygon;
+	while(position < text.size()){
+	  ++lineNumber;
+	  std::string_view keyword = word();
+	  if(keyword == "v"){
+		Vec3r vertex;
+		for (int axis = 0; axis < 3; ++axis) {
+		  if(!number(vertex[axis])){
+			return fail("expected three vertex coordinates");
+		  }
+		}
+		mesh.vertices.push_back(vertex);
+	  }else if(keyword == "f"){
+		polygon.clear();
+		for(std::string_view reference = word(); !reference.empty(); reference = word()){
+		  std::optional<std::uint32_t> index = vertexIndex(reference);
+		  if(!index.has_value()){
+			return fail("invalid vertex reference '" + std::string(reference) + "'");
+		  }
+		  polygon.push_back(index.value());
+		}
+		if(polygon.size() < 3){
+		  return fail("a face needs at least three vertices");
+		}
+		for (std::size_t i = 1; i + 1 < polygon.size(); ++i) {
+		  mesh.faces.push_back({polygon[0],polygon[i],polygon[i+1]});
+		}
+	  }
+	  skipLine();
+	}
+	return true;
+  }
+  bool fail(std::string error){
+	message = std::move(error);
+	return false;
+  }
+  //Next whitespace separated word on the current line, or an empty view at the end of the line or at a comment
+  std::string_view word(){
+	while(position < text.size() && (text[position] == ' ' || text[position] == '\t' || text[position] == '\r')){
+	  ++position;
+	}
+	std::size_t begin = position;
+	if(position < text.size() && text[position] == '#'){
+	  return {};
+	}
+	while(position < text.size() && text[position] != ' ' && text[position] != '\t' && text[position] != '\r' &&
+		text[position] != '\n'){
+	  ++position;
+	}
+	return text.substr(begin,position-begin);
+  }
+  bool number(Real& value){
+	std::string_view digits = word();
+	auto [end, error] = std::from_chars(digits.data(),digits.data()+digits.size(),value);
+	return !digits.empty() && error == std::errc() && end == digits.data()+digits.size();
+  }
+  //Zero based position index of a reference such as 7, 7/2, 7//3 or -1
+  std::optional<std::uint32_t> vertexIndex(std::string_view reference) const{
+	std::string_view digits = reference.substr(0,reference.find('/'));
+	long index = 0;
+	auto [end, error] = std::from_chars(digits.data(),digits.data()+digits.size(),index);
+	if(error != std::errc() || end != digits.data()+digits.size() || index == 0){
+	  return std::nullopt;
+	}
+	long numVertices = static_cast<long>(mesh.vertices.size());
+	long zeroBased = index > 0 ? index - 1 : numVertices + index;
+	if(zeroBased < 0 || zeroBased >= numVertices){
+	  return std::nullopt;
+	}
+	return static_cast<std::uint32_t>(zeroBased);
+  }
+  void skipLine(){
+	std::size_t end = text.find('\n',position);
+	position = end == std::string_view::npos ? text.size() : end + 1;
+  }
+
+  std::string_view text;
+  std::size_t position = 0;
+  std::size_t lineNumber = 0;
+  std::string message;
+  TriangleMesh mesh;
+};
+
+#endif //RAYTRACING_SRC_OBJFILE_H_
@@ -0,0 +1,283 @@
+#ifndef RAYTRACING_SRC_PRIMITIVEARRAYS_H_
+#define RAYTRACING_SRC_PRIMITIVEARRAYS_H_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Sphere.h"
+#include "Rectangle.h"
+#include "Triangle.h"
+#include "Instance.h"
+#include "Vec3Batch.h"
+
+//Spheres in structure of arrays layout, so that several spheres are intersected with one SIMD quadratic solve
+class SphereArray{
+ public:
+  static constexpr std::size_t lanes = simdBytes / sizeof(Real);
+  using RealVec = typename SimdLanes<Real,lanes>::Vec;
+  using Vec3Lanes = Vec3Batch<Real,lanes>;
+
+  void push_back(const SphereData& sphere){
+	centerX.push_back(sphere.origin.x());
+	centerY.push_back(sphere.origin.y());
+	centerZ.push_back(sphere.origin.z());
+	velocityX.push_back(sphere.velocity.x());
+	velocityY.push_back(sphere.velocity.y());
+	velocityZ.push_back(sphere.velocity.z());
+	radius.push_back(sphere.radius);
+	material.push_back(sphere.mat);
+  }
+  //Pads the arrays so that the last spheres can be loaded as a full vector
+  void finalize(){
+	std::size_t padded = material.size() + lanes;
+	for(auto* values : {&centerX,&centerY,&centerZ,&velocityX,&velocityY,&velocityZ,&radius}){
+	  values->resize(padded,Real(0.0));
+	}
+  }
+  [[nodiscard]] std::size_t size() const { return material.size();}
+  [[nodiscard]] std::size_t memoryBytes() const{
+	return 7 * centerX.size() * sizeof(Real) + material.size() * sizeof(Material);
+  }
+
+  //Returns the closest sphere in [begin,end) which is hit in [tMin,tMax] and narrows tMax to it, or end if there is none
+  [[nodiscard]] std::size_t closestHit(const Ray& ray, std::size_t begin, std::size_t end, Real tMin, Real& tMax) const{
+	std::size_t closest = end;
+	Real a = ray.direction.squaredNorm();
+	Vec3Lanes origin(ray.origin);
+	Vec3Lanes direction(ray.direction);
+	for (std::size_t base = begin; base < end; base += lanes) {
+	  Vec3Lanes center = load(centerX,centerY,centerZ,base) + load(velocityX,velocityY,velocityZ,base) * ray.timeOffset;
+	  Vec3Lanes originToCenter = origin - center;
+	  RealVec sphereRadius = load(radius,base);
+
+	  RealVec halfB = originToCenter.dot(direction);
+	  RealVec c = originToCenter.squaredNorm() - sphereRadius * sphereRadius;
+	  RealVec discriminant = halfB * halfB - a * c;
+	  RealVec sqrtDiscriminant = sqrtLanes(discriminant > 0 ? discriminant : RealVec{});
+	  RealVec nearRoot = (-halfB - sqrtDiscriminant) / a;
+	  RealVec farRoot = (-halfB + sqrtDiscriminant) / a;
+	  RealVec root = (nearRoot >= tMin) & (nearRoot <= tMax) ? nearRoot : farRoot;
+	  auto valid = (discriminant >= 0) & (root >= tMin) & (root <= tMax);
+
+	  std::size_t numLanes = std::min(lanes,end-base);
+	  for (std::size_t lane = 0; lane < numLanes; ++lane) {
+		if(valid[lane] && root[lane] <= tMax){
+		  tMax = root[lane];
+		  closest = base + lane;
+		}
+	  }
+	}
+	return closest;
+  }
+  [[nodiscard]] HitRecord hitRecord(std::size_t index, const Ray& ray, Real t) const{
+	Vec3r center(centerX[index] + velocityX[index] * ray.timeOffset,
+				 centerY[index] + velocityY[index] * ray.timeOffset,
+				 centerZ[index] + velocityZ[index] * ray.timeOffset);
+	return sphereHitRecord(ray,t,center,radius[index],material[index]);
+  }
+ private:
+  static RealVec load(const std::vector<Real>& values, std::size_t index){
+	RealVec result;
+	std::memcpy(&result,values.data()+index,sizeof(RealVec));
+	return result;
+  }
+  static Vec3Lanes load(const std::vector<Real>& x, const std::vector<Real>& y, const std::vector<Real>& z,
+						std::size_t index){
+	return Vec3Lanes(load(x,index),load(y,index),load(z,index));
+  }
+  std::vector<Real> centerX, centerY, centerZ;
+  std::vector<Real> velocityX, velocityY, velocityZ;
+  std::vector<Real> radius;
+  std::vector<Material> material;
+};
+
+//Triangles in structure of arrays layout, so that several triangles are intersected with one SIMD Möller–Trumbore test.
+//Every triangle is a face of a mesh. Its corners are gathered from the vertex buffer of the mesh when it is tested,
+//so the leaves do not hold a second copy of the geometry.
+class TriangleArray{
+ public:
+  static constexpr std::size_t lanes = simdBytes / sizeof(Real);
+  using RealVec = typename SimdLanes<Real,lanes>::Vec;
+  using Vec3Lanes = Vec3Batch<Real,lanes>;
+
+  void push_back(const MeshTriangle& triangle){
+	meshes.push_back(&triangle.mesh());
+	faces.push_back(triangle.face());
+  }
+  [[nodiscard]] std::size_t size() const { return faces.size();}
+  [[nodiscard]] std::size_t memoryBytes() const{
+	return meshes.size() * sizeof(const TriangleMesh*) + faces.size() * sizeof(std::uint32_t);
+  }
+
+  //Returns the closest triangle in [begin,end) which is hit in [tMin,tMax] and narrows tMax to it, or end if there is none
+  [[nodiscard]] std::size_t closestHit(const Ray& ray, std::size_t begin, std::size_t end, Real tMin, Real& tMax) const{
+	std::size_t closest = end;
+	Vec3Lanes origin(ray.origin);
+	Vec3Lanes direction(ray.direction);
+	for (std::size_t base = begin; base < end; base += lanes) {
+	  std::size_t numLanes = std::min(lanes,end-base);
+	  //Gathering a fixed number of lanes lets the loop unroll into register inserts. Lanes past the end repeat the
+	  //last triangle and are skipped below
+	  Vec3Lanes vertex;
+	  Vec3Lanes edge1;
+	  Vec3Lanes edge2;
+	  for (std::size_t lane = 0; lane < lanes; ++lane) {
+		Vec3r corner;
+		Vec3r laneEdge1;
+		Vec3r laneEdge2;
+		corners(std::min(base + lane,end - 1),corner,laneEdge1,laneEdge2);
+		vertex.set(lane,corner);
+		edge1.set(lane,laneEdge1);
+		edge2.set(lane,laneEdge2);
+	  }
+
+	  Vec3Lanes p = direction.cross(edge2);
+	  RealVec determinant = edge1.dot(p);
+	  RealVec inverseDeterminant = Real(1.0) / determinant;
+
+	  Vec3Lanes toOrigin = origin - vertex;
+	  RealVec u = toOrigin.dot(p) * inverseDeterminant;
+
+	  Vec3Lanes q = toOrigin.cross(edge1);
+	  RealVec v = direction.dot(q) * inverseDeterminant;
+	  RealVec t = edge2.dot(q) * inverseDeterminant;
+
+	  auto valid = (determinant != 0) & (u >= 0) & (v >= 0) & (u + v <= 1) & (t >= tMin) & (t <= tMax);
+
+	  for (std::size_t lane = 0; lane < numLanes; ++lane) {
+		if(valid[lane] && t[lane] <= tMax){
+		  tMax = t[lane];
+		  closest = base + lane;
+		}
+	  }
+	}
+	return closest;
+  }
+  [[nodiscard]] HitRecord hitRecord(std::size_t index, const Ray& ray, Real t) const{
+	Vec3r vertex;
+	Vec3r edge1;
+	Vec3r edge2;
+	corners(index,vertex,edge1,edge2);
+	return triangleHitRecord(ray,t,edge1.cross(edge2),meshes[index]->material);
+  }
+ private:
+  //First corner of a triangle and the edges from it to the other two, the same as those of TriangleData
+  void corners(std::size_t index, Vec3r& vertex, Vec3r& edge1, Vec3r& edge2) const{
+	const TriangleMesh& mesh = *meshes[index];
+	const std::array<std::uint32_t,3>& indices = mesh.faces[faces[index]];
+	vertex = mesh.vertices[indices[0]];
+	edge1 = mesh.vertices[indices[1]] - vertex;
+	edge2 = mesh.vertices[indices[2]] - vertex;
+  }
+  std::vector<const TriangleMesh*> meshes;
+  std::vector<std::uint32_t> faces; //Index into the faces of the mesh
+};
+
+//Primitives of the BVH leaves, segregated by type. Objects are added in BVH order, where every leaf lists its
+//spheres, then its rectangles, then its triangles and then its instances, so a leaf maps onto one contiguous
+//range of each array.
+class PrimitiveArrays{
+ public:
+  void push_back(const SphereData& sphere){
+	addOffsets();
+	spheres.push_back(sphere);
+  }
+  void push_back(const AARectangleData& rectangle){
+	addOffsets();
+	rectangles.push_back(rectangle);
+  }
+  void push_back(const MeshTriangle& triangle){
+	addOffsets();
+	triangles.push_back(triangle);
+  }
+  void push_back(const Instance& instance){
+	addOffsets();
+	instances.push_back(instance);
+  }
+  void finalize(){
+	addOffsets();
+	spheres.finalize();
+  }
+  //Instanced geometry is shared, so it is not counted here
+  [[nodiscard]] std::size_t memoryBytes() const{
+	return spheres.memoryBytes() + rectangles.size() * sizeof(AARectangleData) + triangles.memoryBytes() +
+		instances.size() * sizeof(Instance) +
+		(sphereOffset.size() + rectangleOffset.size() + triangleOffset.size()) * sizeof(std::uint32_t);
+  }
+
+  //Closest hit among the objects [begin,begin+count) of a leaf. Narrows tMax and updates hit when a closer one is found
+  void hit(const Ray& ray, std::uint32_t begin, std::uint32_t count, Real tMin, Real& tMax, std::optional<PrimitiveHit>& hit) const{
+	std::uint32_t end = begin + count;
+	//Object index of the first object of the type which is being tested
+	std::uint32_t first = begin;
+	std::uint32_t sphereBegin = sphereOffset[begin];
+	std::uint32_t sphereEnd = sphereOffset[end];
+	if(sphereBegin != sphereEnd){
+	  std::size_t closest = spheres.closestHit(ray,sphereBegin,sphereEnd,tMin,tMax);
+	  if(closest != sphereEnd){
+		hit = PrimitiveHit{.t = tMax,.primitive = first + static_cast<std::uint32_t>(closest - sphereBegin)};
+	  }
+	}
+	first += sphereEnd - sphereBegin;
+	std::uint32_t rectangleBegin = rectangleOffset[begin];
+	std::uint32_t rectangleEnd = rectangleOffset[end];
+	for (std::uint32_t i = rectangleBegin; i < rectangleEnd; ++i) {
+	  std::optional<Real> t = rectangles[i].intersect(ray,tMin,tMax);
+	  if(t.has_value()){
+		tMax = t.value();
+		hit = PrimitiveHit{.t = tMax,.primitive = first + i - rectangleBegin};
+	  }
+	}
+	first += rectangleEnd - rectangleBegin;
+	std::uint32_t triangleBegin = triangleOffset[begin];
+	std::uint32_t triangleEnd = triangleOffset[end];
+	if(triangleBegin != triangleEnd){
+	  std::size_t closest = triangles.closestHit(ray,triangleBegin,triangleEnd,tMin,tMax);
+	  if(closest != triangleEnd){
+		hit = PrimitiveHit{.t = tMax,.primitive = first + static_cast<std::uint32_t>(closest - triangleBegin)};
+	  }
+	}
+	first += triangleEnd - triangleBegin;
+	//The instances come last, so the instances before the leaf are the objects which are of no other type
+	std::uint32_t instanceBegin = begin - sphereBegin - rectangleBegin - triangleBegin;
+	for (std::uint32_t i = instanceBegin; first < end; ++i, ++first) {
+	  std::optional<PrimitiveHit> instanceHit = instances[i].intersect(ray,tMin,tMax);
+	  if(instanceHit.has_value()){
+		tMax = instanceHit->t;
+		hit = PrimitiveHit{.t = tMax,.primitive = first,.instancePrimitive = instanceHit->primitive};
+	  }
+	}
+  }
+  //Full surface interaction of a hit found by hit()
+  [[nodiscard]] HitRecord surfaceInteraction(const Ray& ray, const PrimitiveHit& hit) const{
+	std::uint32_t sphere = sphereOffset[hit.primitive];
+	if(sphereOffset[hit.primitive+1] != sphere){
+	  return spheres.hitRecord(sphere,ray,hit.t);
+	}
+	std::uint32_t rectangle = rectangleOffset[hit.primitive];
+	if(rectangleOffset[hit.primitive+1] != rectangle){
+	  return rectangles[rectangle].hitRecord(ray,hit.t);
+	}
+	std::uint32_t triangle = triangleOffset[hit.primitive];
+	if(triangleOffset[hit.primitive+1] != triangle){
+	  return triangles.hitRecord(triangle,ray,hit.t);
+	}
+	const Instance& instance = instances[hit.primitive - sphere - rectangle - triangle];
+	return instance.surfaceInteraction(ray,PrimitiveHit{.t = hit.t,.primitive = hit.instancePrimitive});
+  }
+ private:
+  void addOffsets(){
+	sphereOffset.push_back(static_cast<std::uint32_t>(spheres.size()));
+	rectangleOffset.push_back(static_cast<std::uint32_t>(rectangles.size()));
+	triangleOffset.push_back(static_cast<std::uint32_t>(triangles.size()));
+  }
+  SphereArray spheres;
+  std::vector<AARectangleData> rectangles;
+  TriangleArray triangles;
+  std::vector<Instance> instances;
+  std::vector<std::uint32_t> sphereOffset; //Number of spheres before every object
+  std::vector<std::uint32_t> rectangleOffset; //Number of rectangles before every object
+  std::vector<std::uint32_t> triangleOffset; //Number of triangles before every object
+};
+
+#endif //RAYTRACING_SRC_PRIMITIVEARRAYS_H_
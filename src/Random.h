@@ -56,25 +56,25 @@ class RandomDevice64{
 	state *= 0xda942042e4dd58b5;
 	return state >> 64;
   }
-  double randomReal(){
-	return (double)randomUInt()/ double(UINT64_MAX);
+  Real randomReal(){
+	return static_cast<Real>(randomUInt())/ static_cast<Real>(UINT64_MAX);
   }
-  double randomReal(double a, double b){
+  Real randomReal(Real a, Real b){
 	return a + (b-a) * randomReal();
   }
-  Vec3d randomVec(){
+  Vec3r randomVec(){
 	return {randomReal(),randomReal(),randomReal()};
   }
-  Vec3d randomInUnitSphere(){
+  Vec3r randomInUnitSphere(){
 	while(true){
-	  Vec3d vec(randomReal(-1.0,1.0),randomReal(-1.0,1.0), randomReal(-1.0,1.0));
+	  Vec3r vec(randomReal(-1.0,1.0),randomReal(-1.0,1.0), randomReal(-1.0,1.0));
 	  if(vec.squaredNorm() > 1) continue;
 	  return vec;
 	}
   }
-  Vec3d randomInUnitDisk() {
+  Vec3r randomInUnitDisk() {
 	while (true) {
-	  Vec3d vec(randomReal(-1.0, 1.0), randomReal(-1.0, 1.0), 0);
+	  Vec3r vec(randomReal(-1.0, 1.0), randomReal(-1.0, 1.0), 0);
 	  if (vec.squaredNorm() > 1) continue;
 	  return vec;
 	}
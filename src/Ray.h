@@ -5,6 +5,9 @@
 #ifndef RAYTRACING_SRC_RAY_H_
 #define RAYTRACING_SRC_RAY_H_
 #include "Vec3.h"
+#include <array>
+#include <algorithm>
+#include <type_traits>
 
 struct Ray{
   [[nodiscard]] Vec3r at(Real t) const{
@@ -14,4 +17,29 @@ struct Ray{
   Vec3r direction;
   Real timeOffset;
 };
+
+//Hits closer than this are the surface the ray starts on, found again because of rounding. In single precision
+//the rounding error of the origin grows with its distance to the world origin, so the offset has to grow with it.
+[[nodiscard]] inline Real minimumHitDistance(const Ray& ray){
+  constexpr Real absoluteOffset = Real(0.001);
+  if constexpr(std::is_same_v<Real,double>){
+	return absoluteOffset;
+  }else{
+	constexpr Real relativeOffset = Real(1e-5);
+	Real scale = std::max({std::abs(ray.origin.x()),std::abs(ray.origin.y()),std::abs(ray.origin.z())});
+	return absoluteOffset + relativeOffset * scale;
+  }
+}
+
+//Per ray data for bounding box tests, computed once before traversal
+struct TraversalRay{
+  explicit TraversalRay(const Ray& ray) :
+  origin{ray.origin},
+  invDirection{Real(1.0) / ray.direction.x(), Real(1.0) / ray.direction.y(), Real(1.0) / ray.direction.z()},
+  negative{invDirection.x() < 0, invDirection.y() < 0, invDirection.z() < 0}{};
+
+  Vec3r origin;
+  Vec3r invDirection;
+  std::array<bool,3> negative;
+};
 #endif //RAYTRACING_SRC_RAY_H_
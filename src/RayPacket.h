@@ -0,0 +1,68 @@
+#ifndef RAYTRACING_SRC_RAYPACKET_H_
+#define RAYTRACING_SRC_RAYPACKET_H_
+
+#include <array>
+#include "Ray.h"
+#include "Vec3Batch.h"
+
+//A group of coherent rays stored in SIMD lanes, traced through the BVH together. Every ray ignores hits closer than
+//its own minimumHitDistance.
+template<std::size_t Size>
+class RayPacket{
+ public:
+  using RealVec = typename SimdLanes<Real,Size>::Vec;
+  using Vec3Lanes = Vec3Batch<Real,Size>;
+  using Mask = typename Vec3Lanes::Mask;
+
+  explicit RayPacket(const std::array<Ray,Size>& packetRays) : rays{packetRays}, meanDirection(0,0,0){
+	for (std::size_t lane = 0; lane < Size; ++lane) {
+	  const Ray& ray = rays[lane];
+	  origin.set(lane,ray.origin);
+	  invDirection.set(lane,Vec3r(Real(1.0) / ray.direction.x(),Real(1.0) / ray.direction.y(),
+								  Real(1.0) / ray.direction.z()));
+	  tMin[lane] = minimumHitDistance(ray);
+	  meanDirection += ray.direction;
+	}
+  }
+
+  //Slab test of every ray against a single box, returns the lanes which hit it within [minimumDistance(lane),tMax]
+  [[nodiscard]] Mask hit(const Vec3r& min, const Vec3r& max, const RealVec& tMax) const{
+	RealVec tNear = tMin;
+	RealVec tFar = tMax;
+	slab(min.x(),max.x(),origin.x(),invDirection.x(),tNear,tFar);
+	slab(min.y(),max.y(),origin.y(),invDirection.y(),tNear,tFar);
+	slab(min.z(),max.z(),origin.z(),invDirection.z(),tNear,tFar);
+	return tNear < tFar;
+  }
+
+  [[nodiscard]] const Ray& ray(std::size_t lane) const { return rays[lane];}
+  [[nodiscard]] Real minimumDistance(std::size_t lane) const { return tMin[lane];}
+  //Used to order children front to back for the packet as a whole
+  [[nodiscard]] const Vec3r& direction() const { return meanDirection;}
+
+  static bool any(const Mask& mask){
+	bool result = false;
+	for (std::size_t lane = 0; lane < Size; ++lane) {
+	  result |= mask[lane] != 0;
+	}
+	return result;
+  }
+ private:
+  static void slab(Real min, Real max, const RealVec& origin, const RealVec& invDirection,
+				   RealVec& tNear, RealVec& tFar){
+	RealVec t0 = (min - origin) * invDirection;
+	RealVec t1 = (max - origin) * invDirection;
+	RealVec axisNear = t0 < t1 ? t0 : t1;
+	RealVec axisFar = t0 < t1 ? t1 : t0;
+	tNear = axisNear > tNear ? axisNear : tNear;
+	tFar = axisFar < tFar ? axisFar : tFar;
+  }
+
+  std::array<Ray,Size> rays;
+  Vec3Lanes origin;
+  Vec3Lanes invDirection;
+  RealVec tMin;
+  Vec3r meanDirection;
+};
+
+#endif //RAYTRACING_SRC_RAYPACKET_H_
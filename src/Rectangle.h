@@ -7,6 +7,7 @@
 #include "Vec3.h"
 #include "Ray.h"
 #include "HitRecord.h"
+#include <cstdint>
 #include <optional>
 #include "AABB.h"
 
@@ -24,7 +25,7 @@ class AARectangleData{
 				   //U is the first of the rectnagle type, v, the second.
 				  //w indicates the coordinate of the third dimension which is fixed.
   [[nodiscard]] AABB boundingBox() const{
-	constexpr Real epsilon = 0.0001;
+	constexpr Real epsilon = Real(0.0001);
 	switch(type){
 	  case yz:{
 		return {Vec3r(w-epsilon,u1,v1),Vec3r(w+epsilon,u2,v2)};
@@ -37,12 +38,29 @@ class AARectangleData{
 	  }
 	}
   }
+  [[nodiscard]] Material material() const{ return mat;}
+  [[nodiscard]] Real area() const{ return (u2-u1)*(v2-v1);}
+  //Point at the fractions s and t of the u and v extents
+  [[nodiscard]] Vec3r point(Real s, Real t) const{
+	return fromPlane(w,u1 + s*(u2-u1),v1 + t*(v2-v1));
+  }
+  [[nodiscard]] Vec3r normal() const{
+	return fromPlane(Real(1.0),0,0);
+  }
   [[nodiscard]] std::optional<HitRecord> hit(const Ray& ray, Real tMin, Real tMax) const{
+	std::optional<Real> t = intersect(ray,tMin,tMax);
+	if(!t.has_value()){
+	  return std::nullopt;
+	}
+	return hitRecord(ray,t.value());
+  }
+  //Distance to the rectangle if it is hit in [tMin,tMax]
+  [[nodiscard]] std::optional<Real> intersect(const Ray& ray, Real tMin, Real tMax) const{
 	int  wIdx = (int ) type;
 	int  uIdx = ((int) type+1)%3;
 	int  vIdx = ((int ) type+2)%3;
 
-	double tPos = (w-ray.origin[wIdx]) / ray.direction[wIdx];
+	Real tPos = (w-ray.origin[wIdx]) / ray.direction[wIdx];
 	if( tPos < tMin || tPos > tMax){
 	  return std::nullopt;
 	}
@@ -52,12 +70,15 @@ class AARectangleData{
 	if(at[uIdx] < u1 || at[uIdx] > u2 || at[vIdx] < v1 || at[vIdx] > v2){
 	  return std::nullopt;
 	}
+	return tPos;
+  }
+  [[nodiscard]] HitRecord hitRecord(const Ray& ray, Real tPos) const{
+	int  wIdx = (int ) type;
+	Vec3r at = ray.at(tPos);
 
 	//Double sided plane
-	Vec3r normal(0,0,0);
-	normal[wIdx] = 1.0;
-	Real dot = normal.dot(ray.direction);
-	normal[wIdx] = dot < 0.0 ? 1.0 : -1.0;
+	Real dot = ray.direction[wIdx];
+	Vec3r normal = fromPlane(dot < 0.0 ? Real(1.0) : Real(-1.0),0,0);
 	//uv = {(at[u_idx] - u1) / (u2 - u1), (at[v_idx] - v1) / (v2 - v1)};
 	return HitRecord{
 		.point = at,
@@ -67,7 +88,26 @@ class AARectangleData{
 		.frontFace = dot < 0.0 //TODO: what is frontface here?
 	};
   }
+  //Feeds every field to hash, which must accept Real and std::uint64_t
+  template<typename Hash>
+  void hashContent(Hash& hash) const{
+	for(Real value : {u1,u2,v1,v2,w}){
+	  hash.add(value);
+	}
+	hash.add(std::uint64_t(mat.index()));
+	hash.add(std::uint64_t(type));
+  }
  private:
+  //The vector with the given coordinates along the w, u and v axes. Vectors are built whole instead of written one
+  //coordinate at a time, as a write to a single lane of a SIMD vector stalls the next read of the whole vector.
+  [[nodiscard]] Vec3r fromPlane(Real wValue, Real uValue, Real vValue) const{
+	switch(type){
+	  case yz: return {wValue,uValue,vValue};
+	  case zx: return {vValue,wValue,uValue};
+	  case xy: break;
+	}
+	return {uValue,vValue,wValue};
+  }
   Real u1,u2;
   Real v1,v2;
   Real w;
@@ -0,0 +1,568 @@
+#ifndef RAYTRACING_SRC_RENDERER_H_
+#define RAYTRACING_SRC_RENDERER_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <tbb/enumerable_thread_specific.h>
+
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "LightList.h"
+#include "Random.h"
+#include "Ray.h"
+#include "RayPacket.h"
+#include "Scene.h"
+#include "TileScheduler.h"
+#include "WavefrontIntegrator.h"
+
+//Everything about how an image is rendered which can be changed without recompiling.
+//Adaptive sampling, the wavefront integrator and primary ray packets are exclusive. When several are set, adaptive
+//sampling is used, then the wavefront integrator and then packets of primaryPacketSize.
+struct RenderSettings{
+  int imageWidth = 600;
+  int imageHeight = 600;
+  int samplesPerPixel = 50;
+  int maxDepth = 50;
+  std::size_t numThreads = std::max(std::thread::hardware_concurrency(),1u);
+  int tileSize = 32; //Width and height of the square tiles the image is split into
+  //4, 8 or 16 primary rays per packet, 1 traces them one by one. Instrumented builds only count the work of single rays.
+  std::size_t primaryPacketSize = instrumentationEnabled ? 1 : 8;
+  //Not available in instrumented builds. It has neither next event estimation nor Russian roulette, so it ignores
+  //the three settings below.
+  bool useWavefrontIntegrator = false;
+  bool useNextEventEstimation = true; //Sample the lights at every diffuse hit, combined with MIS
+  bool useRussianRoulette = true;
+  int russianRouletteDepth = 3; //Bounces after which paths are randomly terminated
+  bool useAdaptiveSampling = false; //Spend the samples of a tile on the pixels with the largest error
+  int adaptiveInitialSamples = 8; //Samples every pixel gets before its error is estimated
+  int adaptiveBatchSize = 4; //Samples added per round to every pixel which has not converged
+  int adaptiveMaxSamplesFactor = 8; //A pixel gets at most this many times samplesPerPixel
+  Real adaptiveErrorThreshold = Real(0.005); //Standard error of the displayed, gamma corrected value
+
+  [[nodiscard]] Real aspectRatio() const{ return Real(imageWidth) / Real(imageHeight);}
+  //Describes the first setting the renderer cannot work with, or nothing if all of them are valid
+  [[nodiscard]] std::optional<std::string> error() const{
+	//Pixel coordinates are divided by the width and height minus one
+	if(imageWidth < 2 || imageHeight < 2){ return "the image must be at least 2x2 pixels";}
+	if(samplesPerPixel <= 0){ return "samplesPerPixel must be positive";}
+	if(maxDepth <= 0){ return "maxDepth must be positive";}
+	if(numThreads == 0){ return "numThreads must be positive";}
+	if(tileSize <= 0){ return "tileSize must be positive";}
+	if(primaryPacketSize != 1 && primaryPacketSize != 4 && primaryPacketSize != 8 && primaryPacketSize != 16){
+	  return "primaryPacketSize must be 1, 4, 8 or 16";
+	}
+	if(russianRouletteDepth <= 0){ return "russianRouletteDepth must be positive";}
+	if(adaptiveInitialSamples <= 0 || adaptiveBatchSize <= 0 || adaptiveMaxSamplesFactor <= 0){
+	  return "adaptiveInitialSamples, adaptiveBatchSize and adaptiveMaxSamplesFactor must be positive";
+	}
+	if(!(adaptiveErrorThreshold > 0)){ return "adaptiveErrorThreshold must be positive";}
+	return std::nullopt;
+  }
+};
+
+//Number of closest hit and shadow rays traced, to see how much Russian roulette saves.
+//The traversal counters and path lengths are only filled in when instrumentationEnabled.
+struct PathStatistics{
+  static constexpr std::size_t maxPathLength = 16; //Longer paths are counted in the last bucket
+
+  std::size_t paths = 0;
+  std::size_t segments = 0; //Closest hit rays, including the camera ray
+  std::size_t shadowRays = 0;
+  TraversalCounters traversal; //Of both the closest hit and the shadow rays
+  std::array<std::size_t,maxPathLength+1> pathLengths{}; //Number of paths by their number of segments
+
+  PathStatistics& operator+=(const PathStatistics& other){
+	paths += other.paths;
+	segments += other.segments;
+	shadowRays += other.shadowRays;
+	traversal += other.traversal;
+	for (std::size_t length = 0; length < pathLengths.size(); ++length) {
+	  pathLengths[length] += other.pathLengths[length];
+	}
+	return *this;
+  }
+};
+
+//Paths traced by Renderer::measurePaths with one setting of Russian roulette
+struct PathMeasurement{
+  bool roulette = false;
+  PathStatistics statistics;
+  Real meanRadiance = 0; //Average over the channels of all paths
+  double seconds = 0;
+};
+
+struct RenderStatistics{
+  double seconds = 0;
+  std::size_t tiles = 0;
+  std::size_t samples = 0;
+  std::size_t rays = 0; //Camera, bounce and shadow rays
+  PathStatistics work; //Merged from the counters of all threads
+};
+
+//Running mean and variance of the brightness of the samples of one pixel, using Welford's update
+struct PixelEstimate{
+  Vec3r sum = Vec3r(0,0,0);
+  int samples = 0;
+  Real mean = 0;
+  Real squaredDeviations = 0;
+
+  void add(const Vec3r& color){
+	sum += color;
+	samples++;
+	Real brightness = (color.x() + color.y() + color.z()) / Real(3.0);
+	Real delta = brightness - mean;
+	mean += delta / Real(samples);
+	squaredDeviations += delta * (brightness - mean);
+  }
+  //Standard error of the mean after the square root gamma correction of the output, d sqrt(x) = dx / (2 sqrt(x)).
+  //A single sample has no variance estimate yet, so its error counts as unbounded.
+  [[nodiscard]] Real displayError() const{
+	if(samples < 2){
+	  return std::numeric_limits<Real>::infinity();
+	}
+	Real standardError = std::sqrt(squaredDeviations / Real(samples - 1) / Real(samples));
+	return standardError / (Real(2.0) * std::sqrt(std::max(mean,Real(1e-4))));
+  }
+};
+
+struct BlockJob{
+  int rowStart;
+  int colStart;
+  int numRows;
+  int numCols;
+
+  RandomDevice device;
+  PathStatistics statistics;
+  Framebuffer<Vec3r>* colors; //The whole image. A job only writes the pixels of its own block
+  Framebuffer<int>* sampleCounts; //Number of samples summed into every pixel of colors
+  Framebuffer<float>* traversalCost; //Nodes visited plus primitives tested per sample, when instrumentationEnabled
+};
+
+//Path tracer which splits the image into tiles and renders them on a pool of threads.
+//The framebuffers are kept between calls to render(), so rendering several frames does not reallocate them.
+class Renderer{
+ public:
+  //Throws std::invalid_argument if settings has an error()
+  explicit Renderer(const RenderSettings& settings) : renderSettings{validated(settings)},
+  colorBuffer(settings.imageWidth,settings.imageHeight), sampleCountBuffer(settings.imageWidth,settings.imageHeight),
+  traversalCostBuffer(instrumentationEnabled ? settings.imageWidth : 0,instrumentationEnabled ? settings.imageHeight : 0){}
+
+  //Renders the scene into colors() and sampleCounts(). progress is called after every finished tile with the number
+  //of finished tiles and the total, from whichever thread finished the tile.
+  RenderStatistics render(const Scene& scene, const Camera& camera,
+						  const std::function<void(std::size_t,std::size_t)>& progress = {});
+
+  [[nodiscard]] const RenderSettings& settings() const{ return renderSettings;}
+  //Sum of the samples of every pixel, to be divided by sampleCounts()
+  [[nodiscard]] const Framebuffer<Vec3r>& colors() const{ return colorBuffer;}
+  [[nodiscard]] const Framebuffer<int>& sampleCounts() const{ return sampleCountBuffer;}
+  //Average traversal work of the samples of every pixel. Empty unless instrumentationEnabled.
+  [[nodiscard]] const Framebuffer<float>& traversalCost() const{ return traversalCostBuffer;}
+
+  //Traces one path per pixel without and with Russian roulette. The mean radiance should agree up to noise,
+  //the difference in rays per path is the work roulette saves.
+  [[nodiscard]] std::array<PathMeasurement,2> measurePaths(const Scene& scene, const Camera& camera) const;
+  //Traces one primary ray per pixel and counts how much of the acceleration structure the rays touch
+  [[nodiscard]] TraversalCounters measureTraversal(const Scene& scene, const Camera& camera) const;
+ private:
+  static const RenderSettings& validated(const RenderSettings& settings){
+	if(std::optional<std::string> error = settings.error()){
+	  throw std::invalid_argument("Invalid render settings: " + error.value());
+	}
+	return settings;
+  }
+  //Closest hit, counted in statistics when instrumentationEnabled
+  static std::optional<PrimitiveHit> intersect(const Scene& scene, const Ray& ray, Real tMin, Real tMax,
+											   PathStatistics& statistics){
+	if constexpr(instrumentationEnabled){
+	  return scene.intersect(ray,tMin,tMax,statistics.traversal);
+	}else{
+	  return scene.intersect(ray,tMin,tMax);
+	}
+  }
+  static std::uint64_t traversalWork(const BlockJob& job){
+	return job.statistics.traversal.nodesVisited + job.statistics.traversal.primitiveTests;
+  }
+  Vec3r sampleDirectLight(const HitRecord& hit, const Scene& scene, Real timeOffset, RandomDevice& device,
+						  PathStatistics& statistics) const;
+  Vec3r tracePath(Ray ray, std::optional<PrimitiveHit> primitiveHit, const Scene &scene, int depth,
+				  RandomDevice& device, int rouletteDepth, PathStatistics& statistics) const;
+  Vec3r shadeHit(const Ray &ray, const std::optional<PrimitiveHit>& primitiveHit, const Scene &scene,
+				 RandomDevice& device, PathStatistics& statistics) const;
+  Vec3r rayColor(const Ray &ray, const Scene &scene, RandomDevice& device, PathStatistics& statistics) const;
+
+  Vec3r samplePixel(BlockJob& job, const Camera& camera, const Scene& scene, int i, int j) const;
+  Vec3r renderPixel(BlockJob& job, const Camera& camera, const Scene& scene, int i, int j) const;
+  void runAdaptiveBlockJob(BlockJob& job, const Camera& camera, const Scene& scene) const;
+  template<std::size_t PacketSize>
+  void runPacketBlockJob(BlockJob& job, const Camera& camera, const Scene& scene) const;
+  void runWavefrontBlockJob(BlockJob& job, const Camera& camera, const Scene& scene) const;
+  void runBlockJob(BlockJob& job, const Camera& camera, const Scene& scene) const;
+
+  RenderSettings renderSettings;
+  Framebuffer<Vec3r> colorBuffer;
+  Framebuffer<int> sampleCountBuffer;
+  Framebuffer<float> traversalCostBuffer;
+};
+
+inline RenderStatistics Renderer::render(const Scene& scene, const Camera& camera,
+								  const std::function<void(std::size_t,std::size_t)>& progress){
+  std::vector<Tile> tiles = mortonOrderTiles(renderSettings.imageWidth,renderSettings.imageHeight,renderSettings.tileSize);
+  std::atomic<std::size_t> completedTiles = 0;
+  tbb::enumerable_thread_specific<PathStatistics> threadStatistics;
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+  renderTiles(tiles,renderSettings.numThreads,[&](std::size_t index, const Tile& tile){
+	//Seeded by tile, so the image does not depend on which thread renders which tile
+	BlockJob job{
+	  .rowStart = tile.rowStart,
+	  .colStart = tile.colStart,
+	  .numRows = tile.numRows,
+	  .numCols = tile.numCols,
+	  .device = RandomDevice((uint64_t)(index + 1)),
+	  .statistics = PathStatistics{},
+	  .colors = &colorBuffer,
+	  .sampleCounts = &sampleCountBuffer,
+	  .traversalCost = &traversalCostBuffer
+	};
+	runBlockJob(job,camera,scene);
+	threadStatistics.local() += job.statistics;
+	std::size_t completed = ++completedTiles;
+	if(progress){
+	  progress(completed,tiles.size());
+	}
+  });
+  auto endTime = std::chrono::high_resolution_clock::now();
+  PathStatistics work = threadStatistics.combine([](PathStatistics first, const PathStatistics& second){
+	return first += second;
+  });
+  //Adaptive sampling spreads the samples unevenly and may stop short of the budget, so count what was taken
+  std::size_t samples = 0;
+  for (int j = 0; j < renderSettings.imageHeight; ++j) {
+	for(int count : std::as_const(sampleCountBuffer).row(j)){
+	  samples += std::size_t(count);
+	}
+  }
+  return RenderStatistics{
+	.seconds = std::chrono::duration<double>(endTime-startTime).count(),
+	.tiles = tiles.size(),
+	.samples = samples,
+	.rays = work.segments + work.shadowRays,
+	.work = work
+  };
+}
+
+//Direct light at a diffuse hit from one point sampled on a light, divided by the albedo.
+//Weighted against the cosine distributed bounce which could have found the same light.
+inline Vec3r Renderer::sampleDirectLight(const HitRecord& hit, const Scene& scene, Real timeOffset, RandomDevice& device,
+								  PathStatistics& statistics) const{
+  std::optional<LightSample> light = scene.lights().sample(hit.point,timeOffset,device);
+  if(!light.has_value()){
+	return Vec3r(0,0,0);
+  }
+  Ray shadowRay{.origin = hit.point,.direction = light->point - hit.point,.timeOffset = timeOffset};
+  Real cosine = hit.normal.dot(shadowRay.direction.normalized());
+  if(cosine <= 0){
+	return Vec3r(0,0,0);
+  }
+  //The shadow ray ends on the light, so anything hit before its end is an occluder
+  constexpr Real lightOffset = Real(1e-3);
+  statistics.shadowRays++;
+  if(intersect(scene,shadowRay,minimumHitDistance(shadowRay),Real(1.0)-lightOffset,statistics).has_value()){
+	return Vec3r(0,0,0);
+  }
+  Real bsdfPdf = cosine * Real(M_1_PI);
+  return light->radiance * (bsdfPdf / light->pdf * powerHeuristic(light->pdf,bsdfPdf));
+}
+
+//Colour along a ray whose closest hit has already been found, following at most depth hits.
+//With next event estimation, emission found by a bounce is weighted against the light sampling of the previous hit;
+//specular bounces and camera rays cannot be light sampled and keep full weight.
+//After rouletteDepth bounces a path survives with a probability equal to its throughput and is reweighted by its
+//inverse, which keeps the estimate unbiased while ending paths which can no longer contribute much.
+inline Vec3r Renderer::tracePath(Ray ray, std::optional<PrimitiveHit> primitiveHit, const Scene &scene, int depth,
+						  RandomDevice& device, int rouletteDepth, PathStatistics& statistics) const{
+  if(depth <= 0){
+	return Vec3r(0,0,0);
+  }
+  statistics.paths++;
+  statistics.segments++;
+  std::size_t segments = 1;
+  Vec3r radiance(0,0,0);
+  Vec3r throughput(1,1,1);
+  Real bsdfPdf = 0; //Density of the bounce which produced ray, 0 if it was not a diffuse bounce
+  for (int bounce = 1; ; ++bounce) {
+	if(!primitiveHit.has_value()){
+	  radiance += throughput * scene.backgroundColor();
+	  break;
+	}
+	HitRecord hit = scene.surfaceInteraction(ray,primitiveHit.value());
+	const MaterialData& material = scene.material(hit.material);
+	Vec3r emitted = material.emitted(hit);
+	if(bsdfPdf > 0 && emitted.squaredNorm() > 0){
+	  radiance += throughput * emitted * powerHeuristic(bsdfPdf,scene.lights().pdf(ray,hit,emitted));
+	}else{
+	  radiance += throughput * emitted;
+	}
+	if(bounce >= depth){
+	  break;
+	}
+
+	Ray scattered;
+	Vec3r attenuation;
+	if(!material.scatter(ray,hit,scattered,attenuation,device)){
+	  break;
+	}
+	throughput *= attenuation;
+	if(throughput.squaredNorm() == 0){
+	  break; //Nothing more can arrive along this path, e.g. after scattering off the black albedo of a light
+	}
+	bsdfPdf = 0;
+	if(renderSettings.useNextEventEstimation && material.type() == MaterialType::Diffuse){
+	  radiance += throughput * sampleDirectLight(hit,scene,ray.timeOffset,device,statistics);
+	  bsdfPdf = std::max(hit.normal.dot(scattered.direction.normalized()),Real(0.0)) * Real(M_1_PI);
+	}
+	if(bounce >= rouletteDepth){
+	  Real survival = std::min(std::max({throughput.x(),throughput.y(),throughput.z()}),Real(1.0));
+	  if(device.randomReal() >= survival){
+		break;
+	  }
+	  throughput /= survival;
+	}
+	ray = scattered;
+	primitiveHit = intersect(scene, ray, minimumHitDistance(ray), std::numeric_limits<Real>::infinity(), statistics);
+	statistics.segments++;
+	segments++;
+  }
+  if constexpr(instrumentationEnabled){
+	statistics.pathLengths[std::min(segments,PathStatistics::maxPathLength)]++;
+  }
+  return radiance;
+}
+
+inline Vec3r Renderer::shadeHit(const Ray &ray, const std::optional<PrimitiveHit>& primitiveHit, const Scene &scene,
+						 RandomDevice& device, PathStatistics& statistics) const{
+  int depth = renderSettings.maxDepth;
+  return tracePath(ray,primitiveHit,scene,depth,device,
+				   renderSettings.useRussianRoulette ? renderSettings.russianRouletteDepth : depth,statistics);
+}
+
+inline Vec3r Renderer::rayColor(const Ray &ray, const Scene &scene, RandomDevice& device, PathStatistics& statistics) const{
+  std::optional<PrimitiveHit> hit = intersect(scene, ray, minimumHitDistance(ray), std::numeric_limits<Real>::infinity(), statistics);
+  return shadeHit(ray,hit,scene,device,statistics);
+}
+
+inline std::array<PathMeasurement,2> Renderer::measurePaths(const Scene& scene, const Camera& camera) const{
+  const int imageWidth = renderSettings.imageWidth;
+  const int imageHeight = renderSettings.imageHeight;
+  const int maxDepth = renderSettings.maxDepth;
+  std::array<PathMeasurement,2> measurements;
+  for(bool roulette : {false,true}){
+	RandomDevice device(1);
+	PathStatistics statistics;
+	Vec3r sum(0,0,0);
+	auto startTime = std::chrono::high_resolution_clock::now();
+	for (int j = 0; j < imageHeight; ++j) {
+	  for (int i = 0; i < imageWidth; ++i) {
+		auto u = (Real(i) + device.randomReal()) / Real(imageWidth - 1);
+		auto v = (Real(j) + device.randomReal()) / Real(imageHeight - 1);
+		Ray ray = camera.getRay(u, v, device);
+		std::optional<PrimitiveHit> hit = scene.intersect(ray, minimumHitDistance(ray), std::numeric_limits<Real>::infinity());
+		sum += tracePath(ray,hit,scene,maxDepth,device,roulette ? renderSettings.russianRouletteDepth : maxDepth,statistics);
+	  }
+	}
+	measurements[roulette ? 1 : 0] = PathMeasurement{
+	  .roulette = roulette,
+	  .statistics = statistics,
+	  .meanRadiance = (sum.x()+sum.y()+sum.z()) / (Real(3.0) * Real(statistics.paths)),
+	  .seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-startTime).count()
+	};
+  }
+  return measurements;
+}
+
+inline TraversalCounters Renderer::measureTraversal(const Scene& scene, const Camera& camera) const{
+  const int imageWidth = renderSettings.imageWidth;
+  const int imageHeight = renderSettings.imageHeight;
+  RandomDevice device(1);
+  TraversalCounters counters;
+  for (int j = 0; j < imageHeight; ++j) {
+	for (int i = 0; i < imageWidth; ++i) {
+	  auto u = (Real(i) + device.randomReal()) / Real(imageWidth - 1);
+	  auto v = (Real(j) + device.randomReal()) / Real(imageHeight - 1);
+	  Ray ray = camera.getRay(u, v, device);
+	  (void) scene.intersect(ray, minimumHitDistance(ray), std::numeric_limits<Real>::infinity(), counters);
+	}
+  }
+  return counters;
+}
+
+inline Vec3r Renderer::samplePixel(BlockJob& job, const Camera& camera, const Scene& scene, int i, int j) const{
+  auto u = (Real(i) + job.device.randomReal()) / Real(renderSettings.imageWidth - 1);
+  auto v = (Real(j) + job.device.randomReal()) / Real(renderSettings.imageHeight - 1);
+  Ray ray = camera.getRay(u, v,job.device);
+  return rayColor(ray, scene, job.device, job.statistics);
+}
+inline Vec3r Renderer::renderPixel(BlockJob& job, const Camera& camera, const Scene& scene, int i, int j) const{
+  std::uint64_t workBefore = traversalWork(job);
+  Vec3r pixelColor(0, 0, 0);
+  for (int k = 0; k < renderSettings.samplesPerPixel; ++k) {
+	pixelColor += samplePixel(job,camera,scene,i,j);
+  }
+  if constexpr(instrumentationEnabled){
+	(*job.traversalCost)(i,j) = float(traversalWork(job) - workBefore) / float(renderSettings.samplesPerPixel);
+  }
+  return pixelColor;
+}
+
+//Gives every pixel of the job adaptiveInitialSamples samples and then adds batches to the pixels whose error is above
+//adaptiveErrorThreshold, until all pixels converged or the job has used samplesPerPixel samples per pixel on average.
+inline void Renderer::runAdaptiveBlockJob(BlockJob& job, const Camera& camera, const Scene& scene) const{
+  thread_local std::vector<PixelEstimate> estimates;
+  thread_local std::vector<std::size_t> active;
+  thread_local std::vector<std::uint64_t> work;
+  estimates.assign(size_t(job.numRows*job.numCols),PixelEstimate{});
+  if constexpr(instrumentationEnabled){
+	work.assign(estimates.size(),0);
+  }
+  const int samplesPerPixel = renderSettings.samplesPerPixel;
+  const int maxSamples = samplesPerPixel * renderSettings.adaptiveMaxSamplesFactor;
+  const Real errorThreshold = renderSettings.adaptiveErrorThreshold;
+  long budget = long(samplesPerPixel) * job.numRows * job.numCols;
+
+  auto addSamples = [&](std::size_t pixel, int count){
+	int i = job.colStart + int(pixel) % job.numCols;
+	int j = job.rowStart + int(pixel) / job.numCols;
+	std::uint64_t workBefore = traversalWork(job);
+	for (int k = 0; k < count; ++k) {
+	  estimates[pixel].add(samplePixel(job,camera,scene,i,j));
+	}
+	if constexpr(instrumentationEnabled){
+	  work[pixel] += traversalWork(job) - workBefore;
+	}
+	budget -= count;
+  };
+  for (std::size_t pixel = 0; pixel < estimates.size(); ++pixel) {
+	addSamples(pixel,std::min(renderSettings.adaptiveInitialSamples,samplesPerPixel));
+  }
+  while(budget > 0){
+	active.clear();
+	for (std::size_t pixel = 0; pixel < estimates.size(); ++pixel) {
+	  if(estimates[pixel].samples < maxSamples && estimates[pixel].displayError() > errorThreshold){
+		active.push_back(pixel);
+	  }
+	}
+	if(active.empty()){
+	  break;
+	}
+	//Noisiest pixels first, so they get the samples if the budget runs out during this round
+	std::sort(active.begin(),active.end(),[&](std::size_t first, std::size_t second){
+	  return estimates[first].displayError() > estimates[second].displayError();
+	});
+	for(std::size_t pixel : active){
+	  if(budget <= 0){
+		break;
+	  }
+	  addSamples(pixel,std::min({renderSettings.adaptiveBatchSize,maxSamples - estimates[pixel].samples,int(budget)}));
+	}
+  }
+
+  for (std::size_t pixel = 0; pixel < estimates.size(); ++pixel) {
+	int i = job.colStart + int(pixel) % job.numCols;
+	int j = job.rowStart + int(pixel) / job.numCols;
+	(*job.colors)(i,j) = estimates[pixel].sum;
+	(*job.sampleCounts)(i,j) = estimates[pixel].samples;
+	if constexpr(instrumentationEnabled){
+	  (*job.traversalCost)(i,j) = float(work[pixel]) / float(estimates[pixel].samples);
+	}
+  }
+}
+
+//Traces the primary rays of PacketSize neighbouring pixels as one packet. Secondary bounces are incoherent,
+//so they are traced one ray at a time.
+template<std::size_t PacketSize>
+void Renderer::runPacketBlockJob(BlockJob& job, const Camera& camera, const Scene& scene) const{
+  constexpr int packetWidth = static_cast<int>(PacketSize);
+  for (int j = job.rowStart; j < job.rowStart + job.numRows; ++j) {
+	int i = job.colStart;
+	for (; i + packetWidth <= job.colStart + job.numCols; i += packetWidth) {
+	  std::array<Vec3r,PacketSize> pixelColors;
+	  pixelColors.fill(Vec3r(0, 0, 0));
+	  for (int k = 0; k < renderSettings.samplesPerPixel; ++k) {
+		std::array<Ray,PacketSize> rays;
+		for (std::size_t lane = 0; lane < PacketSize; ++lane) {
+		  auto u = (Real(i + static_cast<int>(lane)) + job.device.randomReal()) / Real(renderSettings.imageWidth - 1);
+		  auto v = (Real(j) + job.device.randomReal()) / Real(renderSettings.imageHeight - 1);
+		  rays[lane] = camera.getRay(u, v,job.device);
+		}
+		auto hits = scene.intersect(RayPacket<PacketSize>(rays), std::numeric_limits<Real>::infinity());
+		for (std::size_t lane = 0; lane < PacketSize; ++lane) {
+		  pixelColors[lane] += shadeHit(rays[lane], hits[lane], scene, job.device, job.statistics);
+		}
+	  }
+	  for (std::size_t lane = 0; lane < PacketSize; ++lane) {
+		(*job.colors)(i+static_cast<int>(lane),j) = pixelColors[lane];
+	  }
+	}
+	//Pixels left over at the end of the row
+	for (; i < job.colStart + job.numCols; ++i) {
+	  (*job.colors)(i,j) = renderPixel(job,camera,scene,i,j);
+	}
+  }
+}
+
+//Starts every sample of the job at once and traces them with the wavefront integrator
+inline void Renderer::runWavefrontBlockJob(BlockJob& job, const Camera& camera, const Scene& scene) const{
+  thread_local WavefrontIntegrator integrator; //Reuses the path buffers between jobs
+  for (int j = job.rowStart; j < job.rowStart + job.numRows; ++j) {
+	for (int i = job.colStart; i < job.colStart + job.numCols; ++i) {
+	  std::size_t pixel = job.colors->index(i,j);
+	  (*job.colors)(i,j) = Vec3r(0, 0, 0);
+	  for (int k = 0; k < renderSettings.samplesPerPixel; ++k) {
+		auto u = (Real(i) + job.device.randomReal()) / Real(renderSettings.imageWidth - 1);
+		auto v = (Real(j) + job.device.randomReal()) / Real(renderSettings.imageHeight - 1);
+		integrator.addPath(camera.getRay(u, v,job.device),pixel);
+	  }
+	}
+  }
+  job.statistics.segments += integrator.trace(scene,renderSettings.maxDepth,job.device,job.colors->data());
+}
+
+inline void Renderer::runBlockJob(BlockJob& job, const Camera& camera, const Scene& scene) const{
+  if(renderSettings.useAdaptiveSampling){
+	runAdaptiveBlockJob(job,camera,scene);
+	return;
+  }
+  for (int j = job.rowStart; j < job.rowStart + job.numRows; ++j) {
+	std::span<int> counts = job.sampleCounts->row(j).subspan(size_t(job.colStart),size_t(job.numCols));
+	std::fill(counts.begin(),counts.end(),renderSettings.samplesPerPixel);
+  }
+  //Only the scalar path tracer counts its traversal work, so instrumented builds always use it
+  if(renderSettings.useWavefrontIntegrator && !instrumentationEnabled){
+	runWavefrontBlockJob(job,camera,scene);
+	return;
+  }
+  switch(instrumentationEnabled ? 1 : renderSettings.primaryPacketSize){
+	case 4: runPacketBlockJob<4>(job,camera,scene); return;
+	case 8: runPacketBlockJob<8>(job,camera,scene); return;
+	case 16: runPacketBlockJob<16>(job,camera,scene); return;
+	default: break;
+  }
+  for (int j = job.rowStart; j < job.rowStart + job.numRows; ++j) {
+	for (int i = job.colStart; i < job.colStart + job.numCols; ++i) {
+	  (*job.colors)(i,j) = renderPixel(job,camera,scene,i,j);
+	}
+  }
+}
+
+#endif //RAYTRACING_SRC_RENDERER_H_
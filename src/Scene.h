@@ -6,12 +6,19 @@
 #define RAYTRACING_SRC_SCENE_H_
 
 #include "Sphere.h"
+#include "Triangle.h"
 #include <vector>
 #include <optional>
+#include <memory>
+#include <span>
+#include <algorithm>
+#include <string>
 #include "HitRecord.h"
 #include "MaterialData.h"
 #include "Material.h"
-#include "BoundingVolumeHierarchy.h"
+#include "Accelerator.h"
+#include "InstanceGeometry.h"
+#include "LightList.h"
 
 class Scene{
  public:
@@ -25,40 +32,182 @@ class Scene{
   }
   void addSphere(SphereData sphere);
   void addRectangle(AARectangleData rectangle);
+  //Every face of the mesh becomes a triangle of the scene, which refers to the vertices of the mesh
+  void addMesh(TriangleMesh mesh);
+  //Places built geometry in the scene. material replaces the materials of the geometry if it is given.
+  //Instanced primitives are not light sampled, so their emission is only found by bounces and converges slower
+  //than that of geometry added directly.
+  void addInstance(std::shared_ptr<const InstanceGeometry> geometry, const Transform& objectToWorld,
+				   std::optional<Material> material = std::nullopt);
+  //Uses spheres and rectangles which live in memory kept alive by storage, such as a mapped scene file,
+  //in place instead of copying them into the scene
+  void usePrimitives(std::span<const SphereData> sphereList, std::span<const AARectangleData> rectangleList,
+					 std::shared_ptr<const void> storage);
 
+  //Finds the closest hit without computing its surface interaction, which is only needed once it is shaded
+  [[nodiscard]] std::optional<PrimitiveHit> intersect(const Ray& ray, Real tMin, Real tMax) const{
+	return std::visit([&](const auto& bvh){ return bvh.intersect(ray,tMin,tMax);},accelerator);
+  }
+  [[nodiscard]] std::optional<PrimitiveHit> intersect(const Ray& ray, Real tMin, Real tMax, TraversalCounters& counters) const{
+	std::optional<PrimitiveHit> hit = std::visit([&](const auto& bvh){ return bvh.intersect(ray,tMin,tMax,counters);},accelerator);
+	counters.hits += hit.has_value();
+	return hit;
+  }
+  template<std::size_t Size>
+  [[nodiscard]] std::array<std::optional<PrimitiveHit>,Size> intersect(const RayPacket<Size>& packet, Real tMax) const{
+	return std::visit([&](const auto& bvh){ return bvh.intersect(packet,tMax);},accelerator);
+  }
+  [[nodiscard]] HitRecord surfaceInteraction(const Ray& ray, const PrimitiveHit& hit) const{
+	return std::visit([&](const auto& bvh){ return bvh.surfaceInteraction(ray,hit);},accelerator);
+  }
   [[nodiscard]] std::optional<HitRecord> hit(const Ray& ray, Real tMin, Real tMax) const{
-	return bvh.hit(ray,tMin,tMax);
+	std::optional<PrimitiveHit> primitiveHit = intersect(ray,tMin,tMax);
+	if(!primitiveHit.has_value()){
+	  return std::nullopt;
+	}
+	return surfaceInteraction(ray,primitiveHit.value());
   }
-  void setBackgroundColor(Vec3r color){
-	bgColor = color;
+  void setBackgroundColor(const Vec3d& color){
+	bgColor = Vec3r(color);
   }
   [[nodiscard]] const Vec3r& backgroundColor() const{
 	return bgColor;
   }
-  void initialize(Real shutterTime,RandomDevice& device);
+  void initialize(Real shutterTime,RandomDevice& device,const BVHSettings& bvhSettings = BVHSettings());
+  //Moves the spheres along their velocities for the given time and updates the acceleration structure, for the next
+  //frame of an animation. The hierarchy is refitted, keeping its topology, unless the SAH cost of the refitted
+  //hierarchy exceeds rebuildThreshold times the cost of the last build. Returns true when it was built again instead.
+  bool advance(Real time, RandomDevice& device, Real rebuildThreshold);
+  //Emissive spheres and rectangles, collected by initialize()
+  [[nodiscard]] const LightList& lights() const{
+	return lightList;
+  }
+  [[nodiscard]] const BVHBuildStatistics& bvhStatistics() const{
+	return std::visit([](const auto& bvh) -> const BVHBuildStatistics& { return bvh.buildStatistics();},accelerator);
+  }
+  //Size of the nodes and leaf primitives, which scales with the precision of Real. Instanced geometry is counted once.
+  [[nodiscard]] std::size_t acceleratorBytes() const{
+	std::size_t bytes = std::visit([](const auto& bvh){ return bvh.memoryBytes();},accelerator);
+	std::vector<const InstanceGeometry*> geometries;
+	for(const Instance& instance : instances){
+	  geometries.push_back(&instance.instancedGeometry());
+	}
+	std::sort(geometries.begin(),geometries.end());
+	geometries.erase(std::unique(geometries.begin(),geometries.end()),geometries.end());
+	for(const InstanceGeometry* geometry : geometries){
+	  bytes += geometry->memoryBytes();
+	}
+	return bytes;
+  }
  private:
+  //Objects in the order the hierarchy is built from, which also collects the lights
+  std::vector<BVHObject> collectObjects();
+  void build(const std::vector<BVHObject>& objects, RandomDevice& device, const BVHSettings& bvhSettings);
+
   Vec3r bgColor;
   std::vector<SphereData> spheres;
   std::vector<AARectangleData> rectangles;
+  //Shared, so the faces in the accelerator stay valid in copies of the scene
+  std::vector<std::shared_ptr<const TriangleMesh>> meshes;
+  std::vector<Instance> instances;
+  std::span<const SphereData> externalSpheres;
+  std::span<const AARectangleData> externalRectangles;
+  std::shared_ptr<const void> externalStorage;
 
-  BVH bvh;
+  Accelerator accelerator;
+  //Binary hierarchy of a wide accelerator, kept when it is refittable. A binary accelerator is refitted in place.
+  std::optional<BVH> hierarchy;
+  Real shutter = 0;
+  BVHSettings settings;
+  Real builtSahCost = 0; //Of the last build, which refits are compared against
   std::vector<MaterialData> materials;
+  LightList lightList;
 };
 
-void Scene::initialize(Real shutterTime,RandomDevice& device){
+inline void Scene::initialize(Real shutterTime,RandomDevice& device,const BVHSettings& bvhSettings){
+  shutter = shutterTime;
+  settings = bvhSettings;
+  build(collectObjects(),device,settings);
+}
+inline bool Scene::advance(Real time, RandomDevice& device, Real rebuildThreshold){
+  //Mapped spheres cannot be moved, so they are copied behind the others, which keeps the order of the objects
+  if(!externalSpheres.empty()){
+	spheres.insert(spheres.end(),externalSpheres.begin(),externalSpheres.end());
+	externalSpheres = {};
+  }
+  for(SphereData& sphere : spheres){
+	sphere.advance(time);
+  }
+  std::vector<BVHObject> objects = collectObjects();
+  BVH* bvh = hierarchy.has_value() ? &hierarchy.value() : std::get_if<BVH>(&accelerator);
+  if(bvh != nullptr && bvh->refit(objects,shutter) <= rebuildThreshold * builtSahCost){
+	if(hierarchy.has_value()){
+	  accelerator = settings.layout == BVHLayout::Wide8 ? Accelerator(BVH8(*hierarchy)) : Accelerator(BVH4(*hierarchy));
+	}
+	return false;
+  }
+  //Every frame would get its own key, so they are not cached
+  BVHSettings rebuildSettings = settings;
+  rebuildSettings.cacheDirectory.clear();
+  build(objects,device,rebuildSettings);
+  return true;
+}
+inline std::vector<BVHObject> Scene::collectObjects(){
   std::vector<BVHObject> objects;
-  for(const auto& sphere : spheres){
-	objects.emplace_back(sphere);
+  std::size_t numTriangles = 0;
+  for(const auto& mesh : meshes){
+	numTriangles += mesh->faces.size();
   }
-  for(const auto& rectangle : rectangles){
-	objects.emplace_back(rectangle);
+  objects.reserve(spheres.size() + externalSpheres.size() + rectangles.size() + externalRectangles.size() + numTriangles +
+	  instances.size());
+  lightList = LightList();
+  auto addObject = [&](const auto& primitive){
+	objects.emplace_back(primitive);
+	Vec3r emission = material(primitive.material()).emission();
+	if(emission.squaredNorm() > 0){
+	  lightList.push_back(primitive,emission);
+	}
+  };
+  std::for_each(spheres.begin(),spheres.end(),addObject);
+  std::for_each(externalSpheres.begin(),externalSpheres.end(),addObject);
+  std::for_each(rectangles.begin(),rectangles.end(),addObject);
+  std::for_each(externalRectangles.begin(),externalRectangles.end(),addObject);
+  for(const auto& mesh : meshes){
+	for (std::uint32_t face = 0; face < mesh->faces.size(); ++face) {
+	  addObject(MeshTriangle(*mesh,face));
+	}
   }
-  bvh = BVH(objects,shutterTime,device);
+  for(const Instance& instance : instances){
+	objects.emplace_back(&instance);
+  }
+  return objects;
 }
-void Scene::addSphere(SphereData sphere) {
+inline void Scene::build(const std::vector<BVHObject>& objects, RandomDevice& device, const BVHSettings& bvhSettings){
+  BVH bvh = buildHierarchy(objects,shutter,device,bvhSettings);
+  builtSahCost = bvh.buildStatistics().sahCost;
+  hierarchy.reset();
+  if(bvhSettings.refittable && bvhSettings.layout != BVHLayout::Binary){
+	hierarchy = bvh;
+  }
+  accelerator = acceleratorLayout(std::move(bvh),bvhSettings.layout);
+}
+inline void Scene::addSphere(SphereData sphere) {
   spheres.push_back(sphere);
 }
-void Scene::addRectangle(AARectangleData rectangle){
+inline void Scene::addRectangle(AARectangleData rectangle){
   rectangles.push_back(rectangle);
 }
+inline void Scene::addMesh(TriangleMesh mesh){
+  meshes.push_back(std::make_shared<const TriangleMesh>(std::move(mesh)));
+}
+inline void Scene::addInstance(std::shared_ptr<const InstanceGeometry> geometry, const Transform& objectToWorld,
+						std::optional<Material> material){
+  instances.emplace_back(std::move(geometry),objectToWorld,material);
+}
+inline void Scene::usePrimitives(std::span<const SphereData> sphereList, std::span<const AARectangleData> rectangleList,
+						  std::shared_ptr<const void> storage){
+  externalSpheres = sphereList;
+  externalRectangles = rectangleList;
+  externalStorage = std::move(storage);
+}
 #endif //RAYTRACING_SRC_SCENE_H_
@@ -0,0 +1,315 @@
+#ifndef RAYTRACING_SRC_SCENEFILE_H_
+#define RAYTRACING_SRC_SCENEFILE_H_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Camera.h"
+#include "MappedFile.h"
+#include "Scene.h"
+
+//Binary scene file. A header is followed by the materials, spheres, rectangles and meshes, each section starting on a
+//64 byte boundary. Spheres and rectangles are stored as the SphereData and AARectangleData of the build which wrote
+//the file, so a mapped file is used by Scene as it is; the header records the precision and record sizes so that a
+//file from an incompatible build is rejected instead of misread. Materials are few and stored in double precision.
+//Meshes are a table of SceneFileMesh records, each pointing to its own vertex and face sections. Vertices are stored
+//in the precision of Real as well. All numbers are in the byte order of the machine which wrote the file.
+constexpr std::array<char,8> sceneFileMagic = {'R','T','S','C','E','N','E','\0'};
+constexpr std::uint32_t sceneFileVersion = 3;
+constexpr std::size_t sceneFileAlignment = 64;
+
+struct SceneFileCamera{
+  std::array<double,3> lookFrom;
+  std::array<double,3> lookAt;
+  std::array<double,3> up;
+  double verticalFov; //Degrees
+  double aperture;
+  double focusDistance;
+  double shutterTime;
+};
+
+struct SceneFileHeader{
+  std::array<char,8> magic;
+  std::uint32_t version;
+  std::uint32_t realBytes; //sizeof(Real) of the writing build
+  std::uint32_t sphereBytes; //sizeof(SphereData) of the writing build
+  std::uint32_t rectangleBytes;
+  std::uint32_t materialBytes;
+  std::uint32_t padding;
+  SceneFileCamera camera;
+  std::array<double,3> background;
+  std::uint64_t numMaterials;
+  std::uint64_t materialOffset;
+  std::uint64_t numSpheres;
+  std::uint64_t sphereOffset;
+  std::uint64_t numRectangles;
+  std::uint64_t rectangleOffset;
+  std::uint64_t numMeshes;
+  std::uint64_t meshOffset;
+};
+
+struct SceneFileMaterial{
+  std::uint32_t type; //MaterialType
+  std::uint32_t padding;
+  std::array<double,3> color;
+  std::array<double,3> emission;
+  double parameter; //Fuzziness of a metal, refractive index of a dielectric
+};
+
+struct SceneFileMesh{
+  std::uint64_t material;
+  std::uint64_t numVertices;
+  std::uint64_t vertexOffset; //Vertices are stored as three Reals
+  std::uint64_t numFaces;
+  std::uint64_t faceOffset; //Faces are stored as three 32 bit vertex indices
+};
+
+using SceneFileVertex = std::array<Real,3>;
+using SceneFileFace = std::array<std::uint32_t,3>;
+
+static_assert(std::is_trivially_copyable_v<SphereData> && std::is_trivially_copyable_v<AARectangleData>,
+			  "Primitives are written and mapped as raw bytes");
+
+inline std::uint64_t alignSceneFileSection(std::uint64_t offset){
+  return (offset + sceneFileAlignment - 1) / sceneFileAlignment * sceneFileAlignment;
+}
+
+inline std::array<double,3> toSceneFileArray(const Vec3r& vec){
+  return {static_cast<double>(vec.x()),static_cast<double>(vec.y()),static_cast<double>(vec.z())};
+}
+inline Vec3d fromSceneFileArray(const std::array<double,3>& values){
+  return {values[0],values[1],values[2]};
+}
+
+inline SceneFileMaterial toSceneFileMaterial(const MaterialData& material){
+  SceneFileMaterial record{.type = static_cast<std::uint32_t>(material.type()),.padding = 0,.color = {},.emission = {},
+						.parameter = 0};
+  switch(material.type()){
+	case MaterialType::Diffuse:
+	  record.color = toSceneFileArray(material.get<DiffuseMaterial>().color);
+	  record.emission = toSceneFileArray(material.get<DiffuseMaterial>().emittedColor);
+	  break;
+	case MaterialType::Metal:
+	  record.color = toSceneFileArray(material.get<MetalMaterial>().color);
+	  record.parameter = static_cast<double>(material.get<MetalMaterial>().metalFuzziness);
+	  break;
+	case MaterialType::Dielectric:
+	  record.parameter = static_cast<double>(material.get<DielectricMaterial>().refractionIndex);
+	  break;
+  }
+  return record;
+}
+
+inline std::optional<MaterialData> fromSceneFileMaterial(const SceneFileMaterial& record){
+  switch(static_cast<MaterialType>(record.type)){
+	case MaterialType::Diffuse:
+	  return MaterialData(DiffuseMaterial(fromSceneFileArray(record.color),fromSceneFileArray(record.emission)));
+	case MaterialType::Metal: return MaterialData(MetalMaterial(fromSceneFileArray(record.color),record.parameter));
+	case MaterialType::Dielectric: return MaterialData(DielectricMaterial(record.parameter));
+  }
+  return std::nullopt;
+}
+
+//Contents of a scene file, as built by the converter before it is written
+struct SceneDescription{
+  SceneFileCamera camera{};
+  Vec3d background = Vec3d(0,0,0);
+  std::vector<MaterialData> materials;
+  std::vector<SphereData> spheres;
+  std::vector<AARectangleData> rectangles;
+  std::vector<TriangleMesh> meshes;
+};
+
+//Returns false when the file cannot be written
+inline bool writeSceneFile(const std::string& path, const SceneDescription& description){
+  SceneFileHeader header{
+	.magic = sceneFileMagic,
+	.version = sceneFileVersion,
+	.realBytes = sizeof(Real),
+	.sphereBytes = sizeof(SphereData),
+	.rectangleBytes = sizeof(AARectangleData),
+	.materialBytes = sizeof(SceneFileMaterial),
+	.padding = 0,
+	.camera = description.camera,
+	.background = {description.background.x(),description.background.y(),description.background.z()},
+	.numMaterials = description.materials.size(),
+	.materialOffset = alignSceneFileSection(sizeof(SceneFileHeader)),
+	.numSpheres = description.spheres.size(),
+	.sphereOffset = 0,
+	.numRectangles = description.rectangles.size(),
+	.rectangleOffset = 0,
+	.numMeshes = description.meshes.size(),
+	.meshOffset = 0
+  };
+  header.sphereOffset = alignSceneFileSection(header.materialOffset + header.numMaterials * sizeof(SceneFileMaterial));
+  header.rectangleOffset = alignSceneFileSection(header.sphereOffset + header.numSpheres * sizeof(SphereData));
+  header.meshOffset = alignSceneFileSection(header.rectangleOffset + header.numRectangles * sizeof(AARectangleData));
+
+  std::vector<SceneFileMaterial> materials;
+  materials.reserve(description.materials.size());
+  for(const MaterialData& material : description.materials){
+	materials.push_back(toSceneFileMaterial(material));
+  }
+  std::vector<SceneFileMesh> meshes;
+  std::uint64_t meshDataOffset = header.meshOffset + description.meshes.size() * sizeof(SceneFileMesh);
+  for(const TriangleMesh& mesh : description.meshes){
+	SceneFileMesh record{.material = mesh.material.index(),.numVertices = mesh.vertices.size(),
+						 .vertexOffset = alignSceneFileSection(meshDataOffset),.numFaces = mesh.faces.size(),.faceOffset = 0};
+	record.faceOffset = alignSceneFileSection(record.vertexOffset + record.numVertices * sizeof(SceneFileVertex));
+	meshDataOffset = record.faceOffset + record.numFaces * sizeof(SceneFileFace);
+	meshes.push_back(record);
+  }
+
+  std::ofstream file(path,std::ios::binary);
+  std::uint64_t position = 0;
+  auto writeSection = [&](std::uint64_t offset, const void* data, std::size_t bytes){
+	static constexpr std::array<char,sceneFileAlignment> zeros{};
+	file.write(zeros.data(),static_cast<std::streamsize>(offset - position));
+	file.write(static_cast<const char*>(data),static_cast<std::streamsize>(bytes));
+	position = offset + bytes;
+  };
+  writeSection(0,&header,sizeof(SceneFileHeader));
+  writeSection(header.materialOffset,materials.data(),materials.size() * sizeof(SceneFileMaterial));
+  writeSection(header.sphereOffset,description.spheres.data(),description.spheres.size() * sizeof(SphereData));
+  writeSection(header.rectangleOffset,description.rectangles.data(),description.rectangles.size() * sizeof(AARectangleData));
+  writeSection(header.meshOffset,meshes.data(),meshes.size() * sizeof(SceneFileMesh));
+  for (std::size_t i = 0; i < meshes.size(); ++i) {
+	const TriangleMesh& mesh = description.meshes[i];
+	std::vector<SceneFileVertex> vertices;
+	vertices.reserve(mesh.vertices.size());
+	for(const Vec3r& vertex : mesh.vertices){
+	  vertices.push_back({vertex.x(),vertex.y(),vertex.z()});
+	}
+	writeSection(meshes[i].vertexOffset,vertices.data(),vertices.size() * sizeof(SceneFileVertex));
+	writeSection(meshes[i].faceOffset,mesh.faces.data(),mesh.faces.size() * sizeof(SceneFileFace));
+  }
+  return file.good();
+}
+
+//Maps a scene file and builds the scene on top of it. The spheres and rectangles are used straight from the mapping,
+//which the scene keeps alive. On failure error describes what was wrong with the file.
+inline std::optional<std::pair<Scene,Camera>> loadSceneFile(const std::string& path, RandomDevice& device, Real aspectRatio,
+													 const BVHSettings& bvhSettings, std::string& error){
+  std::shared_ptr<const MappedFile> file = MappedFile::open(path);
+  if(!file){
+	error = "cannot open " + path;
+	return std::nullopt;
+  }
+  std::span<const std::byte> bytes = file->bytes();
+  SceneFileHeader header{};
+  if(bytes.size() < sizeof(SceneFileHeader)){
+	error = "file is too small for a scene header";
+	return std::nullopt;
+  }
+  std::memcpy(&header,bytes.data(),sizeof(SceneFileHeader));
+  if(header.magic != sceneFileMagic){
+	error = "not a scene file";
+	return std::nullopt;
+  }
+  if(header.version != sceneFileVersion){
+	error = "unsupported scene file version " + std::to_string(header.version);
+	return std::nullopt;
+  }
+  if(header.realBytes != sizeof(Real) || header.sphereBytes != sizeof(SphereData) ||
+	  header.rectangleBytes != sizeof(AARectangleData) || header.materialBytes != sizeof(SceneFileMaterial)){
+	error = "scene file was written by a build with a different precision or primitive layout";
+	return std::nullopt;
+  }
+  auto sectionFits = [&](std::uint64_t offset, std::uint64_t count, std::uint64_t recordBytes){
+	return offset % sceneFileAlignment == 0 && offset <= bytes.size() && count <= (bytes.size() - offset) / recordBytes;
+  };
+  if(!sectionFits(header.materialOffset,header.numMaterials,sizeof(SceneFileMaterial)) ||
+	  !sectionFits(header.sphereOffset,header.numSpheres,sizeof(SphereData)) ||
+	  !sectionFits(header.rectangleOffset,header.numRectangles,sizeof(AARectangleData)) ||
+	  !sectionFits(header.meshOffset,header.numMeshes,sizeof(SceneFileMesh))){
+	error = "scene file is truncated";
+	return std::nullopt;
+  }
+
+  Scene scene;
+  for (std::uint64_t i = 0; i < header.numMaterials; ++i) {
+	SceneFileMaterial record{};
+	std::memcpy(&record,bytes.data() + header.materialOffset + i * sizeof(SceneFileMaterial),sizeof(SceneFileMaterial));
+	std::optional<MaterialData> material = fromSceneFileMaterial(record);
+	if(!material.has_value()){
+	  error = "unknown material type " + std::to_string(record.type);
+	  return std::nullopt;
+	}
+	(void) scene.addMaterial(material.value());
+  }
+  //The mapping starts on a page boundary and the sections on 64 byte boundaries, so the records are aligned
+  std::span<const SphereData> spheres(reinterpret_cast<const SphereData*>(bytes.data() + header.sphereOffset),
+									  header.numSpheres);
+  std::span<const AARectangleData> rectangles(
+	  reinterpret_cast<const AARectangleData*>(bytes.data() + header.rectangleOffset),header.numRectangles);
+  for(const SphereData& sphere : spheres){
+	if(sphere.material().index() >= header.numMaterials){
+	  error = "sphere refers to a material which does not exist";
+	  return std::nullopt;
+	}
+  }
+  for(const AARectangleData& rectangle : rectangles){
+	if(rectangle.material().index() >= header.numMaterials){
+	  error = "rectangle refers to a material which does not exist";
+	  return std::nullopt;
+	}
+  }
+  scene.usePrimitives(spheres,rectangles,file);
+
+  //Meshes are few, large and indexed, so they are copied into the scene's buffers
+  std::uint64_t numFaces = 0;
+  for (std::uint64_t i = 0; i < header.numMeshes; ++i) {
+	SceneFileMesh record{};
+	std::memcpy(&record,bytes.data() + header.meshOffset + i * sizeof(SceneFileMesh),sizeof(SceneFileMesh));
+	if(record.material >= header.numMaterials){
+	  error = "mesh refers to a material which does not exist";
+	  return std::nullopt;
+	}
+	if(!sectionFits(record.vertexOffset,record.numVertices,sizeof(SceneFileVertex)) ||
+		!sectionFits(record.faceOffset,record.numFaces,sizeof(SceneFileFace))){
+	  error = "scene file is truncated";
+	  return std::nullopt;
+	}
+	TriangleMesh mesh;
+	mesh.material = Material(record.material);
+	mesh.vertices.resize(record.numVertices);
+	for (std::uint64_t v = 0; v < record.numVertices; ++v) {
+	  SceneFileVertex vertex{};
+	  std::memcpy(&vertex,bytes.data() + record.vertexOffset + v * sizeof(SceneFileVertex),sizeof(SceneFileVertex));
+	  mesh.vertices[v] = Vec3r(vertex[0],vertex[1],vertex[2]);
+	}
+	mesh.faces.resize(record.numFaces);
+	std::memcpy(mesh.faces.data(),bytes.data() + record.faceOffset,record.numFaces * sizeof(SceneFileFace));
+	for(const SceneFileFace& face : mesh.faces){
+	  if(face[0] >= record.numVertices || face[1] >= record.numVertices || face[2] >= record.numVertices){
+		error = "mesh face refers to a vertex which does not exist";
+		return std::nullopt;
+	  }
+	}
+	numFaces += record.numFaces;
+	scene.addMesh(std::move(mesh));
+  }
+  if(header.numSpheres + header.numRectangles + numFaces == 0){
+	error = "scene file has no spheres, rectangles or triangles";
+	return std::nullopt;
+  }
+
+  const SceneFileCamera& cameraRecord = header.camera;
+  Camera camera(Vec3r(fromSceneFileArray(cameraRecord.lookFrom)),Vec3r(fromSceneFileArray(cameraRecord.lookAt)),
+				Vec3r(fromSceneFileArray(cameraRecord.up)),static_cast<Real>(cameraRecord.verticalFov),aspectRatio,
+				static_cast<Real>(cameraRecord.aperture),static_cast<Real>(cameraRecord.focusDistance),
+				static_cast<Real>(cameraRecord.shutterTime));
+  scene.initialize(static_cast<Real>(cameraRecord.shutterTime),device,bvhSettings);
+  scene.setBackgroundColor(fromSceneFileArray(header.background));
+  return std::make_pair(std::move(scene),camera);
+}
+
+#endif //RAYTRACING_SRC_SCENEFILE_H_
@@ -0,0 +1,291 @@
+#ifndef RAYTRACING_SRC_SCENES_H_
+#define RAYTRACING_SRC_SCENES_H_
+
+#include <array>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "Scene.h"
+#include "Camera.h"
+#include "Random.h"
+
+inline std::pair<Scene,Camera> exampleScene(RandomDevice& device, Real aspectRatio, const BVHSettings& bvhSettings) {
+  Scene scene;
+
+  Material groundMat = scene.addMaterial(DiffuseMaterial(Vec3d(0.8,0.8,0.0)));
+  Material ballMat  = scene.addMaterial(DiffuseMaterial(Vec3d(0.1,0.2,0.5)));
+  Material glassMat = scene.addMaterial(DielectricMaterial(1.3));
+  Material metalMat = scene.addMaterial(MetalMaterial(Vec3d(0.8,0.6,0.2),0.0));
+
+  scene.addSphere(SphereData(Vec3d(0.0, -100.5, -1.0), 100,groundMat));
+  scene.addSphere(SphereData(Vec3d(0.0, 0.0, -1.0), 0.5,ballMat));
+  scene.addSphere(SphereData(Vec3d(-1.0, 0.0, -1.0), 0.5, glassMat));
+  scene.addSphere(SphereData(Vec3d(-1.0, 0.0, -1.0), -0.45, glassMat));
+
+  scene.addSphere(SphereData(Vec3d(1.0, 0.0, -1.0), 0.5, metalMat,Vec3d(50.0,0.0,0.0)));
+  scene.setBackgroundColor(Vec3d(0.7,0.8,1.0));
+
+  Vec3r lookfrom(13, 2, 3);
+  Vec3r lookat(0, 0, 0);
+  Real distToFocus = Real(10.0);
+  Real aperture = Real(0.1);
+  Real shutterTime = Real(1 / 250.0);
+
+  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), 20, aspectRatio, aperture, distToFocus,shutterTime);
+  scene.initialize(shutterTime,device,bvhSettings);
+  scene.setBackgroundColor(Vec3d(0.7,0.8,1.0));
+
+  return std::make_pair(scene,camera);
+}
+
+inline std::pair<Scene,Camera> randomScene(RandomDevice& device, Real aspectRatio, const BVHSettings& bvhSettings) {
+  Scene scene;
+
+  Material material = scene.addMaterial(DiffuseMaterial(Vec3d(0.5,0.5,0.5)));
+  scene.addSphere(SphereData(Vec3d(0, -1000, 0), 1000, material));
+
+  for (int a = -11; a < 11; a++) {
+	for (int b = -11; b < 11; b++) {
+	  auto chooseMat = device.randomReal();
+	  Vec3d center(a + 0.9 * device.randomReal(), 0.2, b + 0.9 * device.randomReal());
+	  Vec3r velocity(0.0,0.0,0.0);
+	  if ((center - Vec3d(4, 0.2, 0)).norm() > 0.9) {
+		Material sphereMaterial;
+
+		if (chooseMat < 0.7) {
+		  // diffuse
+		  Vec3d color1 = device.randomVec();
+		  Vec3d color2 = device.randomVec();
+		  sphereMaterial = scene.addMaterial(DiffuseMaterial(color1*color2));
+		  velocity.y() = device.randomReal(0.0,25.0);
+		} else if (chooseMat < 0.9) {
+		  // metal
+		  sphereMaterial = scene.addMaterial(
+			  MetalMaterial(Real(0.5)*device.randomVec()+Real(0.5),device.randomReal(0.0,0.5))
+			  );
+
+		} else {
+		  sphereMaterial = scene.addMaterial(DielectricMaterial(device.randomReal(Real(1.1), Real(1.7))));
+		}
+		scene.addSphere(SphereData(center, 0.2, sphereMaterial, velocity));
+	  }
+	}
+  }
+
+  material = scene.addMaterial(DielectricMaterial(1.5));
+  scene.addSphere(SphereData(Vec3d(0, 1, 0), 1, material));
+
+  material = scene.addMaterial(DiffuseMaterial(Vec3d(0.4, 0.2, 0.1)));
+  scene.addSphere(SphereData(Vec3d(-4, 1, 0), 1, material));
+
+  material = scene.addMaterial(MetalMaterial(Vec3d(0.7,0.6,0.5),0.0));
+  scene.addSphere(SphereData(Vec3d(4, 1, 0), 1, material));
+
+
+  Vec3r lookfrom(13, 2, 3);
+  Vec3r lookat(0, 0, 0);
+  Real distToFocus = Real(10.0);
+  Real aperture = Real(0.1);
+  Real shutterTime = Real(1 / 250.0);
+
+  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), 20, aspectRatio, aperture, distToFocus,shutterTime);
+  scene.initialize(shutterTime,device,bvhSettings);
+  scene.setBackgroundColor(Vec3d(0.7,0.8,1.0));
+
+  return std::make_pair(scene,camera);
+}
+
+inline std::pair<Scene,Camera> randomSceneDark(RandomDevice& device, Real aspectRatio, const BVHSettings& bvhSettings) {
+  Scene scene;
+
+  Material material = scene.addMaterial(DiffuseMaterial(Vec3d(0.5,0.5,0.5)));
+  scene.addSphere(SphereData(Vec3d(0, -1000, 0), 1000, material));
+
+  for (int a = -11; a < 11; a++) {
+	for (int b = -11; b < 11; b++) {
+	  auto chooseMat = device.randomReal();
+	  Vec3d center(a + 0.9 * device.randomReal(), 0.2, b + 0.9 * device.randomReal());
+	  Vec3r velocity(0.0,0.0,0.0);
+	  if ((center - Vec3d(4, 0.2, 0)).norm() > 0.9) {
+		Material sphereMaterial;
+
+		if (chooseMat < 0.7) {
+		  // diffuse
+		  Vec3d color1 = device.randomVec();
+		  Vec3d color2 = device.randomVec();
+		  sphereMaterial = scene.addMaterial(DiffuseMaterial(color1*color2));
+		  velocity.y() = device.randomReal(0.0,25.0);
+		} else if (chooseMat < 0.9) {
+		  // metal
+		  sphereMaterial = scene.addMaterial(
+			  MetalMaterial(Real(0.5)*device.randomVec()+Real(0.5),device.randomReal(0.0,0.5))
+		  );
+
+		} else {
+		  sphereMaterial = scene.addMaterial(DielectricMaterial(device.randomReal(Real(1.1), Real(1.7))));
+		}
+		scene.addSphere(SphereData(center, 0.2, sphereMaterial, velocity));
+	  }
+	}
+  }
+
+  material = scene.addMaterial(DielectricMaterial(1.5));
+  scene.addSphere(SphereData(Vec3d(0, 1, 0), 1, material));
+
+  material = scene.addMaterial(DiffuseMaterial(Vec3d(0.4, 0.2, 0.1),Vec3d(10.0,10.0,10.0)));
+  scene.addSphere(SphereData(Vec3d(-4, 1, 0), 1, material));
+
+  material = scene.addMaterial(MetalMaterial(Vec3d(0.7,0.6,0.5),0.0));
+  scene.addSphere(SphereData(Vec3d(4, 1, 0), 1, material));
+
+
+  Vec3r lookfrom(13, 2, 3);
+  Vec3r lookat(0, 0, 0);
+  Real distToFocus = Real(10.0);
+  Real aperture = Real(0.1);
+  Real shutterTime = Real(1 / 250.0);
+
+  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), 20, aspectRatio, aperture, distToFocus,shutterTime);
+  scene.initialize(shutterTime,device,bvhSettings);
+  scene.setBackgroundColor(Vec3d(0.0,0.0,0.0));
+
+  return std::make_pair(scene,camera);
+}
+
+inline std::pair<Scene,Camera> simpleLight(RandomDevice& device, Real aspectRatio, const BVHSettings& bvhSettings){
+  Scene scene;
+
+  Vec3r lookfrom(26,3,6);
+  Vec3r lookat(0, 2, 0);
+  Real aperture = Real(0.1);
+  Real shutterTime = Real(1 / 250.0);
+
+  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), 20, aspectRatio, aperture, (lookfrom-lookat).norm(),shutterTime);
+
+  Material sphereMat = scene.addMaterial(DiffuseMaterial(Vec3d(0.5,0.8,0.2)));
+
+  scene.addSphere(SphereData(Vec3d(0.0,-1000.0,0.0),1000,sphereMat));
+  scene.addSphere(SphereData(Vec3d(0.0,2.0,0.0),2,sphereMat));
+
+  Material light = scene.addMaterial(DiffuseMaterial(Vec3d(0.0,0.0,0.0),Vec3d(4.0,4.0,4.0)));
+
+  scene.addRectangle(AARectangleData(light,RectangleType::xy,3,5,1,3,-2));
+
+  scene.initialize(shutterTime,device,bvhSettings);
+  scene.setBackgroundColor(Vec3d(0.0,0.0,0.0));
+  return std::make_pair(scene,camera);
+}
+
+inline std::pair<Scene,Camera> cornellBox(RandomDevice& device, Real aspectRatio, const BVHSettings& bvhSettings){
+  Scene scene;
+
+  Vec3r lookfrom(278,278,-800);
+  Vec3r lookat(278,278, 0);
+  Real aperture = Real(0.1);
+  Real shutterTime = Real(1 / 250.0);
+  Real fov = 40.0;
+
+  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), fov, aspectRatio, aperture, (lookfrom-lookat).norm(),shutterTime);
+
+
+  Material red = scene.addMaterial(DiffuseMaterial(Vec3d(.65,.05,.05)));
+  Material white = scene.addMaterial(DiffuseMaterial(Vec3d(.73,.73,.73)));
+  Material green = scene.addMaterial(DiffuseMaterial(Vec3d(.12,.45,.15)));
+
+  Material light= scene.addMaterial(DiffuseMaterial(Vec3d(.0,.0,.0),Vec3d(15,15,15)));
+
+  scene.addRectangle(AARectangleData(green,RectangleType::yz,0,555,0,555,555));
+  scene.addRectangle(AARectangleData(red,RectangleType::yz,0,555,0,555,0));
+  scene.addRectangle(AARectangleData(light,RectangleType::zx,213,343,227,332,554));
+  scene.addRectangle(AARectangleData(white,RectangleType::zx,0,555,0,555,0));
+  scene.addRectangle(AARectangleData(white,RectangleType::zx,0,555,0,555,555));
+  scene.addRectangle(AARectangleData(white,RectangleType::xy,0,555,0,555,555));
+
+  scene.initialize(shutterTime,device,bvhSettings);
+  scene.setBackgroundColor(Vec3d(0.0,0.0,0.0));
+  return std::make_pair(scene,camera);
+}
+
+//A large field of instances of a few clusters of spheres, which only stores the clusters once
+inline std::pair<Scene,Camera> instancedField(RandomDevice& device, Real aspectRatio, const BVHSettings& bvhSettings){
+  Scene scene;
+
+  Vec3r lookfrom(0,4,-4);
+  Vec3r lookat(0,0,12);
+  Real aperture = Real(0.0);
+  Real shutterTime = Real(1 / 250.0);
+
+  Camera camera(lookfrom, lookat, Vec3r(0, 1, 0), 40, aspectRatio, aperture, (lookfrom-lookat).norm(),shutterTime);
+
+  Material ground = scene.addMaterial(DiffuseMaterial(Vec3d(0.5,0.5,0.5)));
+  scene.addSphere(SphereData(Vec3d(0, -1000, 0), 1000, ground));
+
+  constexpr int numClusters = 16;
+  constexpr int numSpheres = 12;
+  std::array<std::shared_ptr<const InstanceGeometry>,numClusters> clusters;
+  for(auto& cluster : clusters){
+	InstanceGeometry geometry;
+	for (int i = 0; i < numSpheres; ++i) {
+	  Vec3r center(device.randomReal(Real(-0.3),Real(0.3)),device.randomReal(Real(0.1),Real(0.7)),
+				   device.randomReal(Real(-0.3),Real(0.3)));
+	  geometry.addSphere(SphereData(center,device.randomReal(Real(0.05),Real(0.15)),ground));
+	}
+	geometry.build(shutterTime,device,bvhSettings);
+	cluster = std::make_shared<const InstanceGeometry>(std::move(geometry));
+  }
+  constexpr int numMaterials = 32;
+  std::array<Material,numMaterials> palette;
+  for(Material& material : palette){
+	if(device.randomReal() < 0.8){
+	  material = scene.addMaterial(DiffuseMaterial(device.randomVec()*device.randomVec()));
+	}else{
+	  material = scene.addMaterial(
+		  MetalMaterial(Real(0.5)*device.randomVec()+Real(0.5),device.randomReal(Real(0.0),Real(0.3))));
+	}
+  }
+  //One instance per square unit of the ground in front of the camera
+  constexpr int halfWidth = 250;
+  constexpr int depth = 500;
+  for (int x = -halfWidth; x < halfWidth; ++x) {
+	for (int z = 0; z < depth; ++z) {
+	  Vec3r position(Real(x) + device.randomReal(Real(0.2),Real(0.8)),0,
+					 Real(z) + device.randomReal(Real(0.2),Real(0.8)));
+	  Transform placement = Transform::translation(position) *
+		  Transform::rotation(Vec3r(0,1,0),device.randomReal(0.0,360.0)) *
+		  Transform::scaling(device.randomReal(Real(0.6),Real(1.0)));
+	  std::size_t cluster = std::min(std::size_t(device.randomReal() * numClusters),std::size_t(numClusters-1));
+	  std::size_t material = std::min(std::size_t(device.randomReal() * numMaterials),std::size_t(numMaterials-1));
+	  scene.addInstance(clusters[cluster],placement,palette[material]);
+	}
+  }
+
+  scene.initialize(shutterTime,device,bvhSettings);
+  scene.setBackgroundColor(Vec3d(0.7,0.8,1.0));
+  return std::make_pair(scene,camera);
+}
+
+using SceneBuilder = std::pair<Scene,Camera>(*)(RandomDevice& device, Real aspectRatio, const BVHSettings& bvhSettings);
+struct NamedScene{
+  std::string_view name;
+  SceneBuilder build;
+};
+constexpr std::array<NamedScene,6> sceneList = {
+	NamedScene{"example",exampleScene},
+	NamedScene{"random",randomScene},
+	NamedScene{"randomDark",randomSceneDark},
+	NamedScene{"simpleLight",simpleLight},
+	NamedScene{"cornellBox",cornellBox},
+	NamedScene{"instancedField",instancedField}
+};
+
+inline std::optional<SceneBuilder> findScene(std::string_view name){
+  for(const NamedScene& scene : sceneList){
+	if(scene.name == name){
+	  return scene.build;
+	}
+  }
+  return std::nullopt;
+}
+
+#endif //RAYTRACING_SRC_SCENES_H_
@@ -7,6 +7,7 @@
 #include "Vec3.h"
 #include "Ray.h"
 #include "HitRecord.h"
+#include <cstdint>
 #include <optional>
 #include "AABB.h"
 
@@ -16,20 +17,57 @@ class Sphere{
  private:
   std::size_t idx;
 };
-std::size_t Sphere::index() const {
+inline std::size_t Sphere::index() const {
   return idx;
 }
+//Surface interaction at distance t along the ray, for a sphere at the given center
+inline HitRecord sphereHitRecord(const Ray& ray, Real t, const Vec3r& sphereCenter, Real radius, Material material){
+  Vec3r point = ray.at(t);
+  Vec3r outwardNormal = (point-sphereCenter) / radius;
+  bool frontFace = ray.direction.dot(outwardNormal) < 0;
+  if(!frontFace){
+	outwardNormal = -outwardNormal;
+  }
+  return HitRecord{.point = point,.normal = outwardNormal , .t = t,.material = material,.frontFace = frontFace,
+  };
+}
+
 class SphereData {
+  friend class SphereArray;
  public:
-  SphereData(Vec3r origin, Real rad, Material material, Vec3r velocity = Vec3r(0,0,0)) : origin{origin}, radius{rad}, velocity{velocity}, mat{material}{};
+  SphereData(const Vec3d& origin, double rad, Material material, const Vec3d& velocity = Vec3d(0,0,0)) :
+  origin{origin}, radius{static_cast<Real>(rad)}, velocity{velocity}, mat{material}{};
 
   [[nodiscard]] std::optional<HitRecord> hit(const Ray& ray, Real tMin, Real tMax) const;
 
   [[nodiscard]] Vec3r center(Real timeOffset) const;
+  //Moves the sphere along its velocity for the given time, such as the time between two frames of an animation
+  void advance(Real time){
+	origin += velocity * time;
+  }
 
   [[nodiscard]] AABB boundingBox(Real maxTimeOffset) const;
+  //Bounds at a single time
+  [[nodiscard]] AABB boundingBoxAt(Real timeOffset) const{
+	Real absRadius = std::abs(radius);
+	Vec3r extent(absRadius,absRadius,absRadius);
+	return {center(timeOffset) - extent,center(timeOffset) + extent};
+  }
 
   [[nodiscard]] Material material() const{ return mat;}
+  [[nodiscard]] Real area() const{ return Real(4.0 * M_PI) * radius * radius;}
+  //Point on the surface in the given unit direction from the center, at the given time
+  [[nodiscard]] Vec3r surfacePoint(const Vec3r& direction, Real timeOffset) const{
+	return center(timeOffset) + std::abs(radius) * direction;
+  }
+  //Feeds every field to hash, which must accept Real, Vec3r and std::uint64_t
+  template<typename Hash>
+  void hashContent(Hash& hash) const{
+	hash.add(origin);
+	hash.add(radius);
+	hash.add(velocity);
+	hash.add(std::uint64_t(mat.index()));
+  }
  private:
   Vec3r origin;
   Real radius;
@@ -39,7 +77,7 @@ class SphereData {
 };
 
 
-std::optional<HitRecord> SphereData::hit(const Ray &ray, Real tMin, Real tMax) const{
+inline std::optional<HitRecord> SphereData::hit(const Ray &ray, Real tMin, Real tMax) const{
   Vec3r sphereCenter = center(ray.timeOffset);
   Vec3r originToCenter = ray.origin-sphereCenter;
   Real a = ray.direction.squaredNorm();
@@ -57,24 +95,19 @@ std::optional<HitRecord> SphereData::hit(const Ray &ray, Real tMin, Real tMax) c
 	  return std::nullopt;
 	}
   }
-  Vec3r point = ray.at(root);
-  Vec3r outwardNormal = (point-sphereCenter) / radius;
-  bool frontFace = ray.direction.dot(outwardNormal) < 0;
-  if(!frontFace){
-	outwardNormal = -outwardNormal;
-  }
-  return HitRecord{.point = point,.normal = outwardNormal , .t = root,.material = mat,.frontFace = frontFace,
-				   };
+  return sphereHitRecord(ray,root,sphereCenter,radius,mat);
 }
-Vec3r SphereData::center(Real timeOffset) const{
+inline Vec3r SphereData::center(Real timeOffset) const{
   return origin + velocity*timeOffset;
 }
-AABB SphereData::boundingBox(Real maxTimeOffset) const {
-  AABB box0(origin - Vec3r(radius,radius,radius),
-			origin + Vec3r(radius,radius,radius));
+inline AABB SphereData::boundingBox(Real maxTimeOffset) const {
+  Real absRadius = std::abs(radius); //negative radii are used for hollow spheres
+  Vec3r extent(absRadius,absRadius,absRadius);
+  AABB box0(origin - extent,
+			origin + extent);
   Vec3r finalCenter =center(maxTimeOffset);
-  AABB box1(finalCenter - Vec3r(radius,radius,radius),
-			finalCenter + Vec3r(radius,radius,radius));
+  AABB box1(finalCenter - extent,
+			finalCenter + extent);
   return {box0,box1};
 }
 
@@ -0,0 +1,70 @@
+#ifndef RAYTRACING_SRC_TILESCHEDULER_H_
+#define RAYTRACING_SRC_TILESCHEDULER_H_
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+
+//Rectangle of pixels which is rendered as one task
+struct Tile{
+  int rowStart;
+  int colStart;
+  int numRows;
+  int numCols;
+};
+
+//Interleaves the bits of x and y, so that sorting by the code walks a Z shaped curve through the plane
+inline std::uint64_t mortonCode(std::uint32_t x, std::uint32_t y){
+  auto spread = [](std::uint64_t value){
+	value = (value | (value << 16)) & 0x0000FFFF0000FFFF;
+	value = (value | (value << 8)) & 0x00FF00FF00FF00FF;
+	value = (value | (value << 4)) & 0x0F0F0F0F0F0F0F0F;
+	value = (value | (value << 2)) & 0x3333333333333333;
+	value = (value | (value << 1)) & 0x5555555555555555;
+	return value;
+  };
+  return spread(x) | (spread(y) << 1);
+}
+
+//Square tiles covering the image in Morton order, so tiles which are close in the list are close in the image.
+//Tiles at the right and top border are cut off at the image edge.
+inline std::vector<Tile> mortonOrderTiles(int imageWidth, int imageHeight, int tileSize){
+  int tilesX = (imageWidth + tileSize - 1) / tileSize;
+  int tilesY = (imageHeight + tileSize - 1) / tileSize;
+  std::vector<std::pair<std::uint64_t,Tile>> ordered;
+  for (int y = 0; y < tilesY; ++y) {
+	for (int x = 0; x < tilesX; ++x) {
+	  Tile tile{.rowStart = y*tileSize,.colStart = x*tileSize,
+				.numRows = std::min(tileSize,imageHeight-y*tileSize),.numCols = std::min(tileSize,imageWidth-x*tileSize)};
+	  ordered.emplace_back(mortonCode(static_cast<std::uint32_t>(x),static_cast<std::uint32_t>(y)),tile);
+	}
+  }
+  std::sort(ordered.begin(),ordered.end(),[](const auto& first, const auto& second){ return first.first < second.first;});
+  std::vector<Tile> tiles;
+  tiles.reserve(ordered.size());
+  for(const auto& [code,tile] : ordered){
+	tiles.push_back(tile);
+  }
+  return tiles;
+}
+
+//Calls renderTile(index,tile) for every tile on numThreads threads. The tile range is split recursively over TBB's
+//work stealing deques, so every thread works through a run of neighbouring tiles and an idle thread steals the
+//largest run which is left. renderTile has to be safe to call concurrently for different tiles.
+template<typename RenderTile>
+void renderTiles(const std::vector<Tile>& tiles, std::size_t numThreads, RenderTile&& renderTile){
+  tbb::task_arena arena(static_cast<int>(numThreads));
+  arena.execute([&](){
+	tbb::parallel_for(tbb::blocked_range<std::size_t>(0,tiles.size()),[&](const tbb::blocked_range<std::size_t>& range){
+	  for (std::size_t i = range.begin(); i < range.end(); ++i) {
+		renderTile(i,tiles[i]);
+	  }
+	},tbb::simple_partitioner());
+  });
+}
+
+#endif //RAYTRACING_SRC_TILESCHEDULER_H_
@@ -0,0 +1,92 @@
+#ifndef RAYTRACING_SRC_TRANSFORM_H_
+#define RAYTRACING_SRC_TRANSFORM_H_
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include "Vec3.h"
+#include "AABB.h"
+
+//Affine transform p -> A p + b, with A stored by rows
+class Transform{
+ public:
+  static Transform identity(){
+	return Transform({Vec3r(1,0,0),Vec3r(0,1,0),Vec3r(0,0,1)},Vec3r(0,0,0));
+  }
+  static Transform translation(const Vec3r& offset){
+	return Transform({Vec3r(1,0,0),Vec3r(0,1,0),Vec3r(0,0,1)},offset);
+  }
+  static Transform scaling(Real factor){
+	return Transform({Vec3r(factor,0,0),Vec3r(0,factor,0),Vec3r(0,0,factor)},Vec3r(0,0,0));
+  }
+  //Counter clockwise rotation around the unit axis, looking down the axis
+  static Transform rotation(const Vec3r& axis, Real degrees){
+	Real radians = degrees * Real(M_PI / 180.0);
+	Real c = std::cos(radians);
+	Real s = std::sin(radians);
+	Real t = 1 - c;
+	Real x = axis.x(), y = axis.y(), z = axis.z();
+	return Transform({Vec3r(t*x*x + c,t*x*y - s*z,t*x*z + s*y),
+					  Vec3r(t*x*y + s*z,t*y*y + c,t*y*z - s*x),
+					  Vec3r(t*x*z - s*y,t*y*z + s*x,t*z*z + c)},Vec3r(0,0,0));
+  }
+
+  //Applies other first, then this
+  Transform operator*(const Transform& other) const{
+	std::array<Vec3r,3> product;
+	for (int i = 0; i < 3; ++i) {
+	  product[i] = Vec3r(rows[i].dot(other.column(0)),rows[i].dot(other.column(1)),rows[i].dot(other.column(2)));
+	}
+	return Transform(product,point(other.offset));
+  }
+  //The rows of the inverse of A are the cross products of its columns, divided by its determinant
+  [[nodiscard]] Transform inverse() const{
+	Vec3r c0 = rows[1].cross(rows[2]);
+	Vec3r c1 = rows[2].cross(rows[0]);
+	Vec3r c2 = rows[0].cross(rows[1]);
+	Real inverseDeterminant = Real(1.0) / rows[0].dot(c0);
+	Transform result({inverseDeterminant * Vec3r(c0.x(),c1.x(),c2.x()),
+					  inverseDeterminant * Vec3r(c0.y(),c1.y(),c2.y()),
+					  inverseDeterminant * Vec3r(c0.z(),c1.z(),c2.z())},Vec3r(0,0,0));
+	result.offset = -result.vector(offset);
+	return result;
+  }
+  [[nodiscard]] Vec3r point(const Vec3r& p) const{
+	return vector(p) + offset;
+  }
+  [[nodiscard]] Vec3r vector(const Vec3r& v) const{
+	return {rows[0].dot(v),rows[1].dot(v),rows[2].dot(v)};
+  }
+  //Multiplies by the transpose of A. Normals are mapped out of the space this transform maps into this way,
+  //so a world to object transform maps object space normals to world space.
+  [[nodiscard]] Vec3r transposedVector(const Vec3r& v) const{
+	return v.x() * rows[0] + v.y() * rows[1] + v.z() * rows[2];
+  }
+  //Smallest box around the transformed box
+  [[nodiscard]] AABB box(const AABB& box) const{
+	Vec3r center = point(box.centroid());
+	Vec3r halfExtent = Real(0.5) * (box.maximum() - box.minimum());
+	Vec3r extent(0,0,0);
+	for (int i = 0; i < 3; ++i) {
+	  extent[i] = std::abs(rows[i].x()) * halfExtent.x() + std::abs(rows[i].y()) * halfExtent.y() +
+		  std::abs(rows[i].z()) * halfExtent.z();
+	}
+	return {center - extent,center + extent};
+  }
+  template<typename Hash>
+  void hashContent(Hash& hash) const{
+	for(const Vec3r& row : rows){
+	  hash.add(row);
+	}
+	hash.add(offset);
+  }
+ private:
+  Transform(const std::array<Vec3r,3>& rows, const Vec3r& offset) : rows{rows}, offset{offset}{}
+  [[nodiscard]] Vec3r column(int i) const{
+	return {rows[0][i],rows[1][i],rows[2][i]};
+  }
+  std::array<Vec3r,3> rows;
+  Vec3r offset;
+};
+
+#endif //RAYTRACING_SRC_TRANSFORM_H_
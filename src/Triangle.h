@@ -0,0 +1,138 @@
+#ifndef RAYTRACING_SRC_TRIANGLE_H_
+#define RAYTRACING_SRC_TRIANGLE_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "Vec3.h"
+#include "Ray.h"
+#include "HitRecord.h"
+#include "AABB.h"
+
+//Surface interaction at distance t along the ray, for a triangle with the given unnormalized normal
+inline HitRecord triangleHitRecord(const Ray& ray, Real t, const Vec3r& normal, Material material){
+  Vec3r outwardNormal = normal.normalized();
+  bool frontFace = ray.direction.dot(outwardNormal) < 0;
+  if(!frontFace){
+	outwardNormal = -outwardNormal;
+  }
+  return HitRecord{.point = ray.at(t),.normal = outwardNormal,.t = t,.material = material,.frontFace = frontFace};
+}
+
+//A single triangle with its corners. Meshes are stored as a TriangleMesh, whose faces the BVH references as
+//MeshTriangle; these are only expanded where corners are needed on their own, such as for light sampling.
+class TriangleData{
+ public:
+  TriangleData(const Vec3r& p0, const Vec3r& p1, const Vec3r& p2, Material material) :
+  vertex{p0}, edge1{p1-p0}, edge2{p2-p0}, mat{material}{}
+
+  [[nodiscard]] AABB boundingBox() const{
+	//Triangles in an axis aligned plane would get a flat box, which rays can slip past
+	constexpr Real epsilon = Real(0.0001);
+	Vec3r p1 = vertex + edge1;
+	Vec3r p2 = vertex + edge2;
+	Vec3r minimum;
+	Vec3r maximum;
+	for (int axis = 0; axis < 3; ++axis) {
+	  minimum[axis] = std::min({vertex[axis],p1[axis],p2[axis]}) - epsilon;
+	  maximum[axis] = std::max({vertex[axis],p1[axis],p2[axis]}) + epsilon;
+	}
+	return {minimum,maximum};
+  }
+  [[nodiscard]] Material material() const{ return mat;}
+  [[nodiscard]] Real area() const{ return Real(0.5) * edge1.cross(edge2).norm();}
+  //Point at the barycentric coordinates belonging to two uniform random numbers s and t, which covers the
+  //triangle uniformly
+  [[nodiscard]] Vec3r point(Real s, Real t) const{
+	Real root = std::sqrt(s);
+	return vertex + (root * (Real(1.0) - t)) * edge1 + (root * t) * edge2;
+  }
+  [[nodiscard]] Vec3r normal() const{
+	return edge1.cross(edge2).normalized();
+  }
+  [[nodiscard]] std::optional<HitRecord> hit(const Ray& ray, Real tMin, Real tMax) const{
+	std::optional<Real> t = intersect(ray,tMin,tMax);
+	if(!t.has_value()){
+	  return std::nullopt;
+	}
+	return triangleHitRecord(ray,t.value(),edge1.cross(edge2),mat);
+  }
+  //Distance to the triangle if it is hit in [tMin,tMax], using the Möller–Trumbore test
+  [[nodiscard]] std::optional<Real> intersect(const Ray& ray, Real tMin, Real tMax) const{
+	Vec3r p = ray.direction.cross(edge2);
+	Real determinant = edge1.dot(p);
+	if(determinant == Real(0.0)){
+	  return std::nullopt;
+	}
+	Real inverseDeterminant = Real(1.0) / determinant;
+	Vec3r toOrigin = ray.origin - vertex;
+	Real u = toOrigin.dot(p) * inverseDeterminant;
+	if(u < 0 || u > 1){
+	  return std::nullopt;
+	}
+	Vec3r q = toOrigin.cross(edge1);
+	Real v = ray.direction.dot(q) * inverseDeterminant;
+	if(v < 0 || u + v > 1){
+	  return std::nullopt;
+	}
+	Real t = edge2.dot(q) * inverseDeterminant;
+	if(t < tMin || t > tMax){
+	  return std::nullopt;
+	}
+	return t;
+  }
+  //Feeds every field to hash, which must accept Vec3r and std::uint64_t
+  template<typename Hash>
+  void hashContent(Hash& hash) const{
+	hash.add(vertex);
+	hash.add(edge1);
+	hash.add(edge2);
+	hash.add(std::uint64_t(mat.index()));
+  }
+ private:
+  Vec3r vertex;
+  Vec3r edge1;
+  Vec3r edge2;
+  Material mat;
+};
+
+//Indexed triangle mesh, where all faces share one vertex buffer and one material
+struct TriangleMesh{
+  std::vector<Vec3r> vertices;
+  std::vector<std::array<std::uint32_t,3>> faces;
+  Material material;
+
+  [[nodiscard]] TriangleData triangle(std::size_t face) const{
+	const std::array<std::uint32_t,3>& indices = faces[face];
+	return {vertices[indices[0]],vertices[indices[1]],vertices[indices[2]],material};
+  }
+};
+
+//One face of a TriangleMesh, which refers to the faces and vertices of the mesh instead of copying its corners.
+//The mesh must outlive it and every hierarchy built from it.
+class MeshTriangle{
+ public:
+  MeshTriangle(const TriangleMesh& mesh, std::uint32_t face) : triangleMesh{&mesh}, faceIndex{face}{}
+
+  [[nodiscard]] const TriangleMesh& mesh() const{ return *triangleMesh;}
+  [[nodiscard]] std::uint32_t face() const{ return faceIndex;}
+  [[nodiscard]] TriangleData triangle() const{ return triangleMesh->triangle(faceIndex);}
+
+  [[nodiscard]] AABB boundingBox() const{ return triangle().boundingBox();}
+  [[nodiscard]] Material material() const{ return triangleMesh->material;}
+  [[nodiscard]] std::optional<HitRecord> hit(const Ray& ray, Real tMin, Real tMax) const{
+	return triangle().hit(ray,tMin,tMax);
+  }
+  //Hashes the corners, so equal geometry gets the same hash whichever mesh it is in
+  template<typename Hash>
+  void hashContent(Hash& hash) const{
+	triangle().hashContent(hash);
+  }
+ private:
+  const TriangleMesh* triangleMesh;
+  std::uint32_t faceIndex;
+};
+
+#endif //RAYTRACING_SRC_TRIANGLE_H_
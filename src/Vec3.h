@@ -7,38 +7,19 @@
 
 #include <concepts>
 #include <cmath>
+#include <algorithm>
 #include "Definitions.h"
 
-template<std::floating_point T>
-class Vec3;
-
-template<std::floating_point T>
-Vec3<T> operator-(const Vec3<T> &u, const Vec3<T> &v);
-
-template<std::floating_point T>
-Vec3<T> operator*(T val, const Vec3<T> &vec);
-
-template<std::floating_point T>
-Vec3<T> operator*(const Vec3<T> &vec, T val);
-
-template<std::floating_point T>
-Vec3<T> operator+(const Vec3<T> &u, const Vec3<T> &v);
-
-template<std::floating_point T>
-Vec3<T> operator+(const Vec3<T> &u, T val);
-
-template<std::floating_point T>
-Vec3<T> operator*(const Vec3<T> &u, const Vec3<T> &v);
-
-template<std::floating_point T>
-Vec3<T> operator/(const Vec3<T> &vec, T val);
-
-
+//Vector of three scalars, stored packed so the nodes, rays and primitives which hold them stay small
 template<std::floating_point T>
 class Vec3 {
  public:
   Vec3() = default;
   Vec3(T a, T b, T c) : element{a, b, c} {};
+  //Converting to a lower precision has to be explicit
+  template<std::floating_point U> requires (!std::same_as<T,U>)
+  explicit(sizeof(U) > sizeof(T)) Vec3(const Vec3<U>& other) :
+	  element{static_cast<T>(other.x()), static_cast<T>(other.y()), static_cast<T>(other.z())} {}
 
   T x() const { return element[0]; }
   T y() const { return element[1]; }
@@ -58,12 +39,30 @@ class Vec3 {
 	element[2] += other.element[2];
 	return *this;
   }
+  Vec3 &operator-=(const Vec3 &other) {
+	element[0] -= other.element[0];
+	element[1] -= other.element[1];
+	element[2] -= other.element[2];
+	return *this;
+  }
   Vec3 &operator*=(const Vec3 &other) {
 	element[0] *= other.element[0];
 	element[1] *= other.element[1];
 	element[2] *= other.element[2];
 	return *this;
   }
+  Vec3 &operator+=(const T val) {
+	element[0] += val;
+	element[1] += val;
+	element[2] += val;
+	return *this;
+  }
+  Vec3 &operator*=(const T val) {
+	element[0] *= val;
+	element[1] *= val;
+	element[2] *= val;
+	return *this;
+  }
 
   Vec3 &operator/=(const T val) {
 	element[0] /= val;
@@ -83,9 +82,18 @@ class Vec3 {
 	return element[0] * other.element[0] + element[1] * other.element[1] + element[2] * other.element[2];
   }
   Vec3 cross(const Vec3& other) const {
-	return Vec3(element[1] * other.element[2] - element[2] * other.element[1],
-				element[2] * other.element[0] - element[0] * other.element[2],
-				element[0] * other.element[1] - element[1] * other.element[0]);
+	if constexpr(std::same_as<T,float> || std::same_as<T,double>){
+	  //this x other = (this * other.yzx - this.yzx * other).yzx in the lanes of one register, three shuffles
+	  using Lanes = typename SimdLanes<T,4>::Vec;
+	  Lanes u{element[0], element[1], element[2], T(0)};
+	  Lanes v{other.element[0], other.element[1], other.element[2], T(0)};
+	  Lanes rotated = u * __builtin_shufflevector(v, v, 1, 2, 0, 3) - __builtin_shufflevector(u, u, 1, 2, 0, 3) * v;
+	  return Vec3(rotated[1], rotated[2], rotated[0]);
+	}else{
+	  return Vec3(element[1] * other.element[2] - element[2] * other.element[1],
+				  element[2] * other.element[0] - element[0] * other.element[2],
+				  element[0] * other.element[1] - element[1] * other.element[0]);
+	}
   }
 
   Vec3 normalized() const{
@@ -94,55 +102,51 @@ class Vec3 {
 	return (vec /= length);
   }
 
-  friend Vec3<T> operator-<>(const Vec3<T> &u, const Vec3<T> &v);
-  friend Vec3<T> operator*<>(T val, const Vec3<T> &vec);
-
-  friend Vec3<T> operator*<>(const Vec3<T> &vec, T val);
-
-  friend Vec3<T> operator+<>(const Vec3<T> &u, const Vec3<T> &v);
-  friend Vec3<T> operator+<>(const Vec3<T> &u,T val);
-
-  friend Vec3<T> operator*<>(const Vec3<T> &u, const Vec3<T> &v);
-
-  friend Vec3<T> operator/<>(const Vec3<T> &u, T val);
-
   [[nodiscard]] bool nearZero() const{
-	constexpr auto s = 1e-8;
+	constexpr auto s = T(1e-8);
 	return(fabs(element[0]) < s && fabs(element[1]) < s && fabs(element[2]) < s );
   }
  private:
   T element[3];
 };
+
 template<std::floating_point T>
 Vec3<T> operator-(const Vec3<T> &u, const Vec3<T> &v) {
-  return Vec3<T>(u.element[0] - v.element[0], u.element[1] - v.element[1], u.element[2] - v.element[2]);
+  Vec3<T> result = u;
+  return result -= v;
 }
 template<std::floating_point T>
 Vec3<T> operator*(T val, const Vec3<T> &vec) {
-  return Vec3(val * vec.element[0], val * vec.element[1], val * vec.element[2]);
+  Vec3<T> result = vec;
+  return result *= val;
 }
 template<std::floating_point T>
 Vec3<T> operator*(const Vec3<T> &vec, T val) {
-  return Vec3(vec.element[0] * val, vec.element[1] * val, vec.element[2] * val);
+  Vec3<T> result = vec;
+  return result *= val;
 }
 
 template<std::floating_point T>
 Vec3<T> operator+(const Vec3<T> &u, const Vec3<T> &v) {
-  return Vec3<T>(u.element[0] + v.element[0], u.element[1] + v.element[1], u.element[2] + v.element[2]);
+  Vec3<T> result = u;
+  return result += v;
 }
 template<std::floating_point T>
 Vec3<T> operator+(const Vec3<T> &u, T val){
-  return Vec3<T>(u.element[0] + val, u.element[1] + val, u.element[2] + val);
+  Vec3<T> result = u;
+  return result += val;
 }
 
 template<std::floating_point T>
 Vec3<T> operator*(const Vec3<T> &u, const Vec3<T> &v) {
-  return Vec3<T>(u.element[0] * v.element[0], u.element[1] * v.element[1], u.element[2] * v.element[2]);
+  Vec3<T> result = u;
+  return result *= v;
 }
 
 template<std::floating_point T>
 Vec3<T> operator/(const Vec3<T> &vec, T val) {
-  return Vec3(vec.element[0] / val, vec.element[1] / val, vec.element[2] / val);
+  Vec3<T> result = vec;
+  return result /= val;
 }
 
 template<std::floating_point T>
@@ -151,9 +155,9 @@ Vec3<T> reflect(const Vec3<T>& v, const Vec3<T>& normal){
 }
 template<std::floating_point T>
 Vec3<T> refract(const Vec3<T>& uv, const Vec3<T>& n, T etai_over_etat) {
-  T cos_theta = fmin((-uv).dot(n), 1.0);
+  T cos_theta = std::min((-uv).dot(n), T(1.0));
   Vec3<T> r_out_perp =  etai_over_etat * (uv + cos_theta*n);
-  T val = std::sqrt(fabs(T(1.0) - r_out_perp.squaredNorm()));
+  T val = std::sqrt(std::abs(T(1.0) - r_out_perp.squaredNorm()));
   Vec3<T> r_out_parallel = (-val) * n;
   return r_out_perp + r_out_parallel;
 }
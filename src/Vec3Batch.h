@@ -0,0 +1,171 @@
+#ifndef RAYTRACING_SRC_VEC3BATCH_H_
+#define RAYTRACING_SRC_VEC3BATCH_H_
+
+#include "Vec3.h"
+
+//Width vectors in structure of arrays layout, with one SIMD register per coordinate. It has the operations of Vec3,
+//applied to every lane at once, so packet and stream kernels read like the scalar code they vectorize.
+//Reductions such as dot() return one value per lane and comparisons return a mask.
+template<std::floating_point T, std::size_t Width>
+class Vec3Batch{
+ public:
+  using Lanes = typename SimdLanes<T,Width>::Vec;
+  using Mask = decltype(Lanes{} < Lanes{});
+
+  Vec3Batch() = default;
+  Vec3Batch(const Lanes& x, const Lanes& y, const Lanes& z) : xLanes{x}, yLanes{y}, zLanes{z}{}
+  //The same vector in every lane
+  explicit Vec3Batch(const Vec3<T>& vec) : xLanes{Lanes{} + vec.x()}, yLanes{Lanes{} + vec.y()},
+  zLanes{Lanes{} + vec.z()}{}
+
+  const Lanes& x() const { return xLanes; }
+  const Lanes& y() const { return yLanes; }
+  const Lanes& z() const { return zLanes; }
+
+  Lanes& x() { return xLanes; }
+  Lanes& y() { return yLanes; }
+  Lanes& z() { return zLanes; }
+
+  //The vector in one lane
+  Vec3<T> operator[](std::size_t lane) const { return Vec3<T>(xLanes[lane], yLanes[lane], zLanes[lane]); }
+  void set(std::size_t lane, const Vec3<T>& vec){
+	xLanes[lane] = vec.x();
+	yLanes[lane] = vec.y();
+	zLanes[lane] = vec.z();
+  }
+
+  Vec3Batch operator-() const { return Vec3Batch(-xLanes, -yLanes, -zLanes); }
+  Vec3Batch& operator+=(const Vec3Batch& other){
+	xLanes += other.xLanes;
+	yLanes += other.yLanes;
+	zLanes += other.zLanes;
+	return *this;
+  }
+  Vec3Batch& operator-=(const Vec3Batch& other){
+	xLanes -= other.xLanes;
+	yLanes -= other.yLanes;
+	zLanes -= other.zLanes;
+	return *this;
+  }
+  Vec3Batch& operator*=(const Vec3Batch& other){
+	xLanes *= other.xLanes;
+	yLanes *= other.yLanes;
+	zLanes *= other.zLanes;
+	return *this;
+  }
+  //Scales the vector in every lane by the value in that lane
+  Vec3Batch& operator*=(const Lanes& values){
+	xLanes *= values;
+	yLanes *= values;
+	zLanes *= values;
+	return *this;
+  }
+  Vec3Batch& operator*=(const T val){
+	xLanes *= val;
+	yLanes *= val;
+	zLanes *= val;
+	return *this;
+  }
+  Vec3Batch& operator/=(const Lanes& values){
+	xLanes /= values;
+	yLanes /= values;
+	zLanes /= values;
+	return *this;
+  }
+
+  Lanes squaredNorm() const {
+	return dot(*this);
+  }
+  Lanes norm() const {
+	return sqrtLanes(squaredNorm());
+  }
+  Lanes dot(const Vec3Batch& other) const {
+	return xLanes * other.xLanes + yLanes * other.yLanes + zLanes * other.zLanes;
+  }
+  Vec3Batch cross(const Vec3Batch& other) const {
+	return Vec3Batch(yLanes * other.zLanes - zLanes * other.yLanes,
+					 zLanes * other.xLanes - xLanes * other.zLanes,
+					 xLanes * other.yLanes - yLanes * other.xLanes);
+  }
+  Vec3Batch normalized() const {
+	Vec3Batch vec = *this;
+	return (vec /= norm());
+  }
+  [[nodiscard]] Mask nearZero() const {
+	constexpr auto s = T(1e-8);
+	return (xLanes < s) & (xLanes > -s) & (yLanes < s) & (yLanes > -s) & (zLanes < s) & (zLanes > -s);
+  }
+ private:
+  Lanes xLanes, yLanes, zLanes;
+};
+
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> operator+(const Vec3Batch<T,Width>& u, const Vec3Batch<T,Width>& v){
+  Vec3Batch<T,Width> result = u;
+  return result += v;
+}
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> operator-(const Vec3Batch<T,Width>& u, const Vec3Batch<T,Width>& v){
+  Vec3Batch<T,Width> result = u;
+  return result -= v;
+}
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> operator*(const Vec3Batch<T,Width>& u, const Vec3Batch<T,Width>& v){
+  Vec3Batch<T,Width> result = u;
+  return result *= v;
+}
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> operator*(const typename Vec3Batch<T,Width>::Lanes& values, const Vec3Batch<T,Width>& vec){
+  Vec3Batch<T,Width> result = vec;
+  return result *= values;
+}
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> operator*(const Vec3Batch<T,Width>& vec, const typename Vec3Batch<T,Width>::Lanes& values){
+  Vec3Batch<T,Width> result = vec;
+  return result *= values;
+}
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> operator*(T val, const Vec3Batch<T,Width>& vec){
+  Vec3Batch<T,Width> result = vec;
+  return result *= val;
+}
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> operator*(const Vec3Batch<T,Width>& vec, T val){
+  Vec3Batch<T,Width> result = vec;
+  return result *= val;
+}
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> operator/(const Vec3Batch<T,Width>& vec, const typename Vec3Batch<T,Width>::Lanes& values){
+  Vec3Batch<T,Width> result = vec;
+  return result /= values;
+}
+
+//Takes the lanes of first where mask is set and those of second elsewhere
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> select(const typename Vec3Batch<T,Width>::Mask& mask, const Vec3Batch<T,Width>& first,
+						  const Vec3Batch<T,Width>& second){
+  return Vec3Batch<T,Width>(mask ? first.x() : second.x(), mask ? first.y() : second.y(),
+							mask ? first.z() : second.z());
+}
+
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> reflect(const Vec3Batch<T,Width>& v, const Vec3Batch<T,Width>& normal){
+  return v - (T(2.0) * v.dot(normal)) * normal;
+}
+template<std::floating_point T, std::size_t Width>
+Vec3Batch<T,Width> refract(const Vec3Batch<T,Width>& uv, const Vec3Batch<T,Width>& n,
+						   const typename Vec3Batch<T,Width>::Lanes& etai_over_etat){
+  using Lanes = typename Vec3Batch<T,Width>::Lanes;
+  Lanes cos_theta = (-uv).dot(n);
+  Lanes one = Lanes{} + T(1.0);
+  cos_theta = cos_theta < one ? cos_theta : one;
+  Vec3Batch<T,Width> r_out_perp = etai_over_etat * (uv + cos_theta * n);
+  Lanes squared = one - r_out_perp.squaredNorm();
+  Lanes val = sqrtLanes(squared < 0 ? -squared : squared);
+  return r_out_perp - val * n;
+}
+
+using Vec3x4 = Vec3Batch<Real,4>;
+using Vec3x8 = Vec3Batch<Real,8>;
+
+#endif //RAYTRACING_SRC_VEC3BATCH_H_
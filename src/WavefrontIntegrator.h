@@ -0,0 +1,92 @@
+#ifndef RAYTRACING_SRC_WAVEFRONTINTEGRATOR_H_
+#define RAYTRACING_SRC_WAVEFRONTINTEGRATOR_H_
+
+#include <array>
+#include <span>
+#include <vector>
+#include "Scene.h"
+
+//Iterative path tracer which advances a whole batch of paths one bounce at a time.
+//Every bounce intersects all live paths, sorts the hits into one queue per material type and then shades
+//each queue in its own loop, so there is no recursion and no per-hit dispatch on the material type.
+class WavefrontIntegrator{
+ public:
+  void addPath(const Ray& ray, std::size_t pixel){
+	paths.push_back(PathState{.ray = ray,.throughput = Vec3r(1.0,1.0,1.0),.pixel = pixel});
+  }
+  //Traces all added paths until they terminate and adds their radiance to the given pixels.
+  //Returns the number of rays which were intersected with the scene.
+  std::size_t trace(const Scene& scene, int maxDepth, RandomDevice& device, std::span<Vec3r> radiance){
+	std::size_t rays = 0;
+	for (int depth = maxDepth; depth > 0 && !paths.empty(); --depth) {
+	  rays += paths.size();
+	  intersect(scene);
+	  sortByMaterial(scene,radiance);
+	  nextPaths.clear();
+	  shade<DiffuseMaterial>(scene,device,radiance,queues[std::size_t(MaterialType::Diffuse)]);
+	  shade<MetalMaterial>(scene,device,radiance,queues[std::size_t(MaterialType::Metal)]);
+	  shade<DielectricMaterial>(scene,device,radiance,queues[std::size_t(MaterialType::Dielectric)]);
+	  std::swap(paths,nextPaths);
+	}
+	paths.clear();
+	return rays;
+  }
+ private:
+  struct PathState{
+	Ray ray;
+	Vec3r throughput;
+	std::size_t pixel;
+  };
+
+  void intersect(const Scene& scene){
+	hits.resize(paths.size());
+	records.resize(paths.size());
+	for (std::size_t i = 0; i < paths.size(); ++i) {
+	  hits[i] = scene.intersect(paths[i].ray, minimumHitDistance(paths[i].ray), std::numeric_limits<Real>::infinity());
+	}
+  }
+  //Paths which escaped the scene pick up the background and end here
+  void sortByMaterial(const Scene& scene, std::span<Vec3r> radiance){
+	for(auto& queue : queues){
+	  queue.clear();
+	}
+	for (std::size_t i = 0; i < paths.size(); ++i) {
+	  if(!hits[i].has_value()){
+		radiance[paths[i].pixel] += paths[i].throughput * scene.backgroundColor();
+		continue;
+	  }
+	  records[i] = scene.surfaceInteraction(paths[i].ray,hits[i].value());
+	  queues[std::size_t(scene.material(records[i].material).type())].push_back(i);
+	}
+  }
+  //Adds emission and scatters every path in the queue, surviving paths are compacted into nextPaths
+  template<typename T>
+  void shade(const Scene& scene, RandomDevice& device, std::span<Vec3r> radiance, const std::vector<std::size_t>& queue){
+	for(std::size_t index : queue){
+	  const PathState& path = paths[index];
+	  const HitRecord& hit = records[index];
+	  const T& material = scene.material(hit.material).get<T>();
+
+	  Ray scattered;
+	  Vec3r attenuation;
+	  bool scatter;
+	  if constexpr(std::is_same_v<T,DiffuseMaterial>){
+		radiance[path.pixel] += path.throughput * material.emitted(hit);
+		scatter = material.scatter(hit,scattered,attenuation,path.ray.timeOffset,device);
+	  }else{
+		scatter = material.scatter(path.ray,hit,scattered,attenuation,device);
+	  }
+	  if(scatter){
+		nextPaths.push_back(PathState{.ray = scattered,.throughput = path.throughput * attenuation,.pixel = path.pixel});
+	  }
+	}
+  }
+
+  std::vector<PathState> paths;
+  std::vector<PathState> nextPaths;
+  std::vector<std::optional<PrimitiveHit>> hits;
+  std::vector<HitRecord> records; //Surface interactions, only computed for paths which hit something
+  std::array<std::vector<std::size_t>,numMaterialTypes> queues;
+};
+
+#endif //RAYTRACING_SRC_WAVEFRONTINTEGRATOR_H_
@@ -0,0 +1,299 @@
+#ifndef RAYTRACING_SRC_WIDEBOUNDINGVOLUMEHIERARCHY_H_
+#define RAYTRACING_SRC_WIDEBOUNDINGVOLUMEHIERARCHY_H_
+
+#include <array>
+#include <vector>
+#include <algorithm>
+
+#include "BoundingVolumeHierarchy.h"
+
+//Node of a collapsed BVH. The bounds of all children are stored per axis in one vector,
+//so a single slab test checks every child at once.
+template<std::size_t Width>
+struct WideBVHNode{
+  using RealVec = typename SimdLanes<Real,Width>::Vec;
+  RealVec minX, minY, minZ;
+  RealVec maxX, maxY, maxZ;
+  std::array<BVHIndex,Width> child; //Node index for inner children, first object for leaf children
+  std::array<BVHIndex,Width> count; //0 for inner children, number of objects for leaf children
+  BVHIndex numChildren;
+};
+
+//Bounds of the children of a node at the opening of the shutter and their change per unit of time, kept next to
+//the nodes for scenes in which objects move
+template<std::size_t Width>
+struct WideBVHMotion{
+  using RealVec = typename SimdLanes<Real,Width>::Vec;
+  RealVec minX, minY, minZ;
+  RealVec maxX, maxY, maxZ;
+  RealVec minVelocityX, minVelocityY, minVelocityZ;
+  RealVec maxVelocityX, maxVelocityY, maxVelocityZ;
+};
+
+template<std::size_t Width>
+class WideBVH{
+  static_assert(Width >= 2 && (Width & (Width-1)) == 0,"Width must be a power of two");
+ public:
+  using RealVec = typename SimdLanes<Real,Width>::Vec;
+
+  WideBVH() = default;
+  explicit WideBVH(const BVH& bvh) : primitives(bvh.primitiveArrays()), statistics(bvh.buildStatistics()){
+	const std::vector<BVHNode>& binaryNodes = bvh.nodeList();
+	const std::vector<MovingAABB>& binaryMotion = bvh.motionBounds();
+	BVHIndex binaryRoot = bvh.rootIndex();
+	if(binaryNodes[binaryRoot].type() == BVHNodeType::Leaf){
+	  //Tiny scenes consist of a single leaf; wrap it in a node with one child
+	  WideBVHNode<Width> node{};
+	  setChild(node,0,binaryNodes[binaryRoot]);
+	  node.numChildren = 1;
+	  nodes.push_back(node);
+	  if(!binaryMotion.empty()){
+		WideBVHMotion<Width> bounds{};
+		setChildMotion(bounds,0,binaryMotion[binaryRoot]);
+		motion.push_back(bounds);
+	  }
+	}else{
+	  collapse(binaryNodes,binaryMotion,binaryRoot);
+	}
+	statistics.numNodes = nodes.size();
+  }
+
+  [[nodiscard]] const BVHBuildStatistics& buildStatistics() const {return statistics;}
+  [[nodiscard]] std::size_t memoryBytes() const{
+	return nodes.size() * sizeof(WideBVHNode<Width>) + motion.size() * sizeof(WideBVHMotion<Width>) +
+		primitives.memoryBytes();
+  }
+
+  [[nodiscard]] std::optional<PrimitiveHit> intersect(const Ray& ray, Real tMin, Real tMax) const{
+	TraversalCounters unused;
+	return motion.empty() ? closestHit<false,false>(ray,tMin,tMax,unused) : closestHit<false,true>(ray,tMin,tMax,unused);
+  }
+  [[nodiscard]] std::optional<PrimitiveHit> intersect(const Ray& ray, Real tMin, Real tMax, TraversalCounters& counters) const{
+	return motion.empty() ? closestHit<true,false>(ray,tMin,tMax,counters) : closestHit<true,true>(ray,tMin,tMax,counters);
+  }
+  //The rays of a packet have their own times, so the packet is tested against the bounds over the whole shutter
+  template<std::size_t Size>
+  [[nodiscard]] std::array<std::optional<PrimitiveHit>,Size> intersect(const RayPacket<Size>& packet, Real tMax) const{
+	using PacketVec = typename RayPacket<Size>::RealVec;
+	using Mask = typename RayPacket<Size>::Mask;
+	std::array<std::optional<PrimitiveHit>,Size> hits;
+	PacketVec laneTMax = PacketVec{} + tMax;
+
+	struct StackEntry{
+	  BVHIndex index;
+	  BVHIndex count;
+	  Mask active;
+	  Real order;
+	};
+	//Bounded like the stack of closestHit
+	std::array<StackEntry,maxBVHDepth*Width> stack;
+	std::size_t stackSize = 0;
+	stack[stackSize++] = StackEntry{.index = 0,.count = 0,.active = Mask{} - 1,.order = 0};
+
+	while(stackSize != 0){
+	  const StackEntry entry = stack[--stackSize];
+	  if(entry.count != 0){
+		for (std::size_t lane = 0; lane < Size; ++lane) {
+		  if(!entry.active[lane]){
+			continue;
+		  }
+		  Real tMaxLane = laneTMax[lane];
+		  primitives.hit(packet.ray(lane),entry.index,entry.count,packet.minimumDistance(lane),tMaxLane,hits[lane]);
+		  laneTMax[lane] = tMaxLane;
+		}
+		continue;
+	  }
+	  const WideBVHNode<Width>& node = nodes[entry.index];
+	  //Children are ordered by the position of their centre along the mean packet direction, furthest pushed first
+	  std::size_t firstPushed = stackSize;
+	  for (BVHIndex i = 0; i < node.numChildren; ++i) {
+		Vec3r min(node.minX[i],node.minY[i],node.minZ[i]);
+		Vec3r max(node.maxX[i],node.maxY[i],node.maxZ[i]);
+		Mask active = packet.hit(min,max,laneTMax);
+		if(!RayPacket<Size>::any(active)){
+		  continue;
+		}
+		StackEntry child{.index = node.child[i],.count = node.count[i],.active = active,
+						 .order = (min+max).dot(packet.direction())};
+		assert(stackSize < stack.size());
+		std::size_t position = stackSize++;
+		while(position > firstPushed && stack[position-1].order < child.order){
+		  stack[position] = stack[position-1];
+		  --position;
+		}
+		stack[position] = child;
+	  }
+	}
+	return hits;
+  }
+  [[nodiscard]] HitRecord surfaceInteraction(const Ray& ray, const PrimitiveHit& hit) const{
+	return primitives.surfaceInteraction(ray,hit);
+  }
+ private:
+  //With Moving, the children are tested at the time of the ray instead of over the whole shutter interval
+  template<bool Counting, bool Moving>
+  [[nodiscard]] std::optional<PrimitiveHit> closestHit(const Ray& ray, Real tMin, Real tMax,
+													TraversalCounters& counters) const{
+	if constexpr(Counting){ counters.rays++; }
+	TraversalRay traversalRay(ray);
+	const Vec3r& invDirection = traversalRay.invDirection;
+	const std::array<bool,3>& negative = traversalRay.negative;
+
+	struct StackEntry{
+	  BVHIndex index;
+	  BVHIndex count;
+	  Real tNear;
+	};
+	//Every level pushes at most Width-1 entries more than it pops, and collapsing never adds levels to the
+	//at most maxBVHDepth levels of the binary hierarchy
+	std::array<StackEntry,maxBVHDepth*Width> stack;
+	std::size_t stackSize = 0;
+	stack[stackSize++] = StackEntry{.index = 0,.count = 0,.tNear = tMin};
+
+	std::optional<PrimitiveHit> hit = std::nullopt;
+	while(stackSize != 0){
+	  const StackEntry entry = stack[--stackSize];
+	  if(entry.tNear > tMax){
+		continue;
+	  }
+	  if constexpr(Counting){ counters.nodesVisited++; }
+	  if(entry.count != 0){
+		if constexpr(Counting){
+		  counters.leavesVisited++;
+		  counters.primitiveTests += entry.count;
+		}
+		primitives.hit(ray,entry.index,entry.count,tMin,tMax,hit);
+		continue;
+	  }
+	  const WideBVHNode<Width>& node = nodes[entry.index];
+	  if constexpr(Counting){ counters.boxTests += node.numChildren; }
+	  RealVec minX = node.minX, minY = node.minY, minZ = node.minZ;
+	  RealVec maxX = node.maxX, maxY = node.maxY, maxZ = node.maxZ;
+	  if constexpr(Moving){
+		const WideBVHMotion<Width>& bounds = motion[entry.index];
+		Real time = ray.timeOffset;
+		minX = bounds.minX + time * bounds.minVelocityX;
+		minY = bounds.minY + time * bounds.minVelocityY;
+		minZ = bounds.minZ + time * bounds.minVelocityZ;
+		maxX = bounds.maxX + time * bounds.maxVelocityX;
+		maxY = bounds.maxY + time * bounds.maxVelocityY;
+		maxZ = bounds.maxZ + time * bounds.maxVelocityZ;
+	  }
+	  RealVec tNear = slab(negative[0] ? maxX : minX,ray.origin.x(),invDirection.x(),RealVec{} + tMin,true);
+	  tNear = slab(negative[1] ? maxY : minY,ray.origin.y(),invDirection.y(),tNear,true);
+	  tNear = slab(negative[2] ? maxZ : minZ,ray.origin.z(),invDirection.z(),tNear,true);
+	  RealVec tFar = slab(negative[0] ? minX : maxX,ray.origin.x(),invDirection.x(),RealVec{} + tMax,false);
+	  tFar = slab(negative[1] ? minY : maxY,ray.origin.y(),invDirection.y(),tFar,false);
+	  tFar = slab(negative[2] ? minZ : maxZ,ray.origin.z(),invDirection.z(),tFar,false);
+	  auto hitMask = tNear <= tFar;
+
+	  //Push the hit children furthest first, so that the nearest child is popped first
+	  std::size_t firstPushed = stackSize;
+	  for (BVHIndex i = 0; i < node.numChildren; ++i) {
+		if(!hitMask[i]){
+		  continue;
+		}
+		StackEntry child{.index = node.child[i],.count = node.count[i],.tNear = tNear[i]};
+		assert(stackSize < stack.size());
+		std::size_t position = stackSize++;
+		while(position > firstPushed && stack[position-1].tNear < child.tNear){
+		  stack[position] = stack[position-1];
+		  --position;
+		}
+		stack[position] = child;
+	  }
+	}
+	return hit;
+  }
+  //Intersects the planes of one axis for all children and narrows the interval bound
+  static RealVec slab(const RealVec& planes, Real origin, Real invDirection, const RealVec& bound, bool near){
+	RealVec t = (planes - origin) * invDirection;
+	return near ? (t > bound ? t : bound) : (t < bound ? t : bound);
+  }
+  static void setChild(WideBVHNode<Width>& node, std::size_t lane, const BVHNode& child){
+	const AABB& box = child.box();
+	node.minX[lane] = box.minimum().x();
+	node.minY[lane] = box.minimum().y();
+	node.minZ[lane] = box.minimum().z();
+	node.maxX[lane] = box.maximum().x();
+	node.maxY[lane] = box.maximum().y();
+	node.maxZ[lane] = box.maximum().z();
+	if(child.type() == BVHNodeType::Leaf){
+	  node.child[lane] = child.leftChild();
+	  node.count[lane] = child.rightChild();
+	}else{
+	  node.child[lane] = INVALID_INDEX;
+	  node.count[lane] = 0;
+	}
+  }
+  static void setChildMotion(WideBVHMotion<Width>& bounds, std::size_t lane, const MovingAABB& child){
+	bounds.minX[lane] = child.minimum().x();
+	bounds.minY[lane] = child.minimum().y();
+	bounds.minZ[lane] = child.minimum().z();
+	bounds.maxX[lane] = child.maximum().x();
+	bounds.maxY[lane] = child.maximum().y();
+	bounds.maxZ[lane] = child.maximum().z();
+	bounds.minVelocityX[lane] = child.minimumVelocity().x();
+	bounds.minVelocityY[lane] = child.minimumVelocity().y();
+	bounds.minVelocityZ[lane] = child.minimumVelocity().z();
+	bounds.maxVelocityX[lane] = child.maximumVelocity().x();
+	bounds.maxVelocityY[lane] = child.maximumVelocity().y();
+	bounds.maxVelocityZ[lane] = child.maximumVelocity().z();
+  }
+  //Pulls the largest inner descendants of binaryIndex up until the node has Width children
+  BVHIndex collapse(const std::vector<BVHNode>& binaryNodes, const std::vector<MovingAABB>& binaryMotion,
+					BVHIndex binaryIndex){
+	std::vector<BVHIndex> children = {binaryNodes[binaryIndex].leftChild(),binaryNodes[binaryIndex].rightChild()};
+	while(children.size() < Width){
+	  auto largest = children.end();
+	  Real largestArea = -1.0;
+	  for(auto it = children.begin(); it != children.end(); ++it){
+		const BVHNode& child = binaryNodes[*it];
+		if(child.type() == BVHNodeType::Node && child.box().surfaceArea() > largestArea){
+		  largestArea = child.box().surfaceArea();
+		  largest = it;
+		}
+	  }
+	  if(largest == children.end()){
+		break;
+	  }
+	  BVHIndex expanded = *largest;
+	  *largest = binaryNodes[expanded].leftChild();
+	  children.push_back(binaryNodes[expanded].rightChild());
+	}
+
+	auto index = static_cast<BVHIndex>(nodes.size());
+	nodes.push_back(WideBVHNode<Width>{});
+	if(!binaryMotion.empty()){
+	  motion.push_back(WideBVHMotion<Width>{});
+	}
+	WideBVHNode<Width> node{};
+	WideBVHMotion<Width> bounds{};
+	node.numChildren = static_cast<BVHIndex>(children.size());
+	for (std::size_t lane = 0; lane < children.size(); ++lane) {
+	  const BVHNode& child = binaryNodes[children[lane]];
+	  setChild(node,lane,child);
+	  if(!binaryMotion.empty()){
+		setChildMotion(bounds,lane,binaryMotion[children[lane]]);
+	  }
+	  if(child.type() == BVHNodeType::Node){
+		node.child[lane] = collapse(binaryNodes,binaryMotion,children[lane]);
+	  }
+	}
+	nodes[index] = node;
+	if(!binaryMotion.empty()){
+	  motion[index] = bounds;
+	}
+	return index;
+  }
+
+  PrimitiveArrays primitives;
+  std::vector<WideBVHNode<Width>> nodes;
+  std::vector<WideBVHMotion<Width>> motion; //Empty when no object moves
+  BVHBuildStatistics statistics;
+};
+
+using BVH4 = WideBVH<4>;
+using BVH8 = WideBVH<8>;
+
+#endif //RAYTRACING_SRC_WIDEBOUNDINGVOLUMEHIERARCHY_H_
@@ -0,0 +1,209 @@
+#include <iostream>
+#include <fstream>
+#include <charconv>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "src/SceneFile.h"
+#include "src/ObjFile.h"
+
+//Converts a text scene description into a binary scene file for the build's precision.
+//One statement per line, # starts a comment:
+//  camera fromX fromY fromZ atX atY atZ upX upY upZ verticalFov aperture focusDistance shutterTime
+//  background r g b
+//  diffuse NAME r g b [emittedR emittedG emittedB]
+//  metal NAME r g b fuzziness
+//  dielectric NAME refractiveIndex
+//  sphere MATERIAL x y z radius [velocityX velocityY velocityZ]
+//  rectangle MATERIAL yz|zx|xy uMin uMax vMin vMax w
+//  mesh MATERIAL file.obj [scale x y z]
+//Materials have to be declared before they are used. Mesh paths are relative to the scene description, and the
+//optional scale and translation are applied to the vertices of the mesh.
+
+std::vector<std::string_view> splitWords(std::string_view line){
+  std::vector<std::string_view> words;
+  std::size_t position = 0;
+  while(true){
+	position = line.find_first_not_of(" \t\r",position);
+	if(position == std::string_view::npos || line[position] == '#'){
+	  break;
+	}
+	std::size_t end = std::min(line.find_first_of(" \t\r",position),line.size());
+	words.push_back(line.substr(position,end - position));
+	position = end;
+  }
+  return words;
+}
+
+//Parses words[first], words[first+1], ... into values, returns false if any of them is not a number
+template<std::size_t N>
+bool parseNumbers(const std::vector<std::string_view>& words, std::size_t first, std::array<double,N>& values){
+  if(words.size() < first + N){
+	return false;
+  }
+  for (std::size_t k = 0; k < N; ++k) {
+	std::string_view word = words[first + k];
+	auto [end, error] = std::from_chars(word.data(),word.data() + word.size(),values[k]);
+	if(error != std::errc() || end != word.data() + word.size()){
+	  return false;
+	}
+  }
+  return true;
+}
+
+//Adds the statement on one line to the description, returns false if it is malformed.
+//Errors in files referenced by the statement are described in error.
+bool parseStatement(const std::vector<std::string_view>& words, SceneDescription& description,
+					std::unordered_map<std::string,Material>& materials, const std::filesystem::path& directory,
+					std::string& error){
+  std::string_view keyword = words[0];
+  auto addMaterial = [&](MaterialData material){
+	std::string name(words[1]);
+	if(materials.contains(name)){
+	  error = "material " + name + " is already defined";
+	  return false;
+	}
+	materials.emplace(name,Material(description.materials.size()));
+	description.materials.push_back(material);
+	return true;
+  };
+  auto findMaterial = [&]() -> std::optional<Material>{
+	auto it = words.size() > 1 ? materials.find(std::string(words[1])) : materials.end();
+	return it == materials.end() ? std::nullopt : std::optional<Material>(it->second);
+  };
+  if(keyword == "camera"){
+	std::array<double,13> values{};
+	if(words.size() != 14 || !parseNumbers(words,1,values)){
+	  return false;
+	}
+	description.camera = SceneFileCamera{.lookFrom = {values[0],values[1],values[2]},
+										 .lookAt = {values[3],values[4],values[5]},.up = {values[6],values[7],values[8]},
+										 .verticalFov = values[9],.aperture = values[10],.focusDistance = values[11],
+										 .shutterTime = values[12]};
+	return true;
+  }
+  if(keyword == "background"){
+	std::array<double,3> color{};
+	if(words.size() != 4 || !parseNumbers(words,1,color)){
+	  return false;
+	}
+	description.background = Vec3d(color[0],color[1],color[2]);
+	return true;
+  }
+  if(keyword == "diffuse"){
+	std::array<double,3> color{};
+	std::array<double,3> emitted{};
+	if((words.size() != 5 && words.size() != 8) || !parseNumbers(words,2,color) ||
+		(words.size() == 8 && !parseNumbers(words,5,emitted))){
+	  return false;
+	}
+	return addMaterial(DiffuseMaterial(fromSceneFileArray(color),fromSceneFileArray(emitted)));
+  }
+  if(keyword == "metal"){
+	std::array<double,4> values{};
+	if(words.size() != 6 || !parseNumbers(words,2,values)){
+	  return false;
+	}
+	return addMaterial(MetalMaterial(Vec3d(values[0],values[1],values[2]),values[3]));
+  }
+  if(keyword == "dielectric"){
+	std::array<double,1> index{};
+	if(words.size() != 3 || !parseNumbers(words,2,index)){
+	  return false;
+	}
+	return addMaterial(DielectricMaterial(index[0]));
+  }
+  if(keyword == "sphere"){
+	std::optional<Material> material = findMaterial();
+	std::array<double,4> values{};
+	std::array<double,3> velocity{};
+	if(!material.has_value() || (words.size() != 6 && words.size() != 9) || !parseNumbers(words,2,values) ||
+		(words.size() == 9 && !parseNumbers(words,6,velocity))){
+	  return false;
+	}
+	description.spheres.emplace_back(Vec3d(values[0],values[1],values[2]),values[3],material.value(),
+									 fromSceneFileArray(velocity));
+	return true;
+  }
+  if(keyword == "rectangle"){
+	std::optional<Material> material = findMaterial();
+	std::array<double,5> values{};
+	if(!material.has_value() || words.size() != 8 || !parseNumbers(words,3,values)){
+	  return false;
+	}
+	std::string_view plane = words[2];
+	RectangleType type = plane == "yz" ? RectangleType::yz : plane == "zx" ? RectangleType::zx : RectangleType::xy;
+	if(plane != "yz" && plane != "zx" && plane != "xy"){
+	  return false;
+	}
+	description.rectangles.emplace_back(material.value(),type,static_cast<Real>(values[0]),static_cast<Real>(values[1]),
+										static_cast<Real>(values[2]),static_cast<Real>(values[3]),
+										static_cast<Real>(values[4]));
+	return true;
+  }
+  if(keyword == "mesh"){
+	std::optional<Material> material = findMaterial();
+	std::array<double,4> transform = {1.0,0.0,0.0,0.0};
+	if(!material.has_value() || (words.size() != 3 && words.size() != 7) ||
+		(words.size() == 7 && !parseNumbers(words,3,transform))){
+	  return false;
+	}
+	std::optional<TriangleMesh> mesh = ObjReader::read((directory / words[2]).string(),material.value(),error);
+	if(!mesh.has_value()){
+	  return false;
+	}
+	Vec3r translation(static_cast<Real>(transform[1]),static_cast<Real>(transform[2]),static_cast<Real>(transform[3]));
+	for(Vec3r& vertex : mesh->vertices){
+	  vertex = static_cast<Real>(transform[0]) * vertex + translation;
+	}
+	description.meshes.push_back(std::move(mesh.value()));
+	return true;
+  }
+  return false;
+}
+
+int main(int argc, char** argv){
+  if(argc != 3){
+	std::cerr<<"Usage: RayTracingSceneConverter scene.txt scene.rtscene\n";
+	return 1;
+  }
+  std::ifstream input(argv[1]);
+  if(!input){
+	std::cerr<<"Cannot open "<<argv[1]<<"\n";
+	return 1;
+  }
+  std::filesystem::path directory = std::filesystem::path(argv[1]).parent_path();
+  SceneDescription description;
+  std::unordered_map<std::string,Material> materials;
+  std::string line;
+  for (std::size_t lineNumber = 1; std::getline(input,line); ++lineNumber) {
+	std::vector<std::string_view> words = splitWords(line);
+	if(words.empty()){
+	  continue;
+	}
+	std::string error;
+	if(!parseStatement(words,description,materials,directory,error)){
+	  std::cerr<<argv[1]<<":"<<lineNumber<<": cannot parse '"<<line<<"'"<<(error.empty() ? "" : ": " + error)<<"\n";
+	  return 1;
+	}
+  }
+  std::size_t numTriangles = 0;
+  for(const TriangleMesh& mesh : description.meshes){
+	numTriangles += mesh.faces.size();
+  }
+  if(description.spheres.empty() && description.rectangles.empty() && numTriangles == 0){
+	std::cerr<<argv[1]<<": the scene has no spheres, rectangles or triangles\n";
+	return 1;
+  }
+  if(!writeSceneFile(argv[2],description)){
+	std::cerr<<"Cannot write "<<argv[2]<<"\n";
+	return 1;
+  }
+  std::cerr<<"Wrote "<<description.materials.size()<<" materials, "<<description.spheres.size()<<" spheres, "
+  <<description.rectangles.size()<<" rectangles and "<<numTriangles<<" triangles in "<<(sizeof(Real) == sizeof(float) ? "float" : "double")
+  <<" precision\n";
+  return 0;
+}